@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bit_io.hpp"
+#include "huffman.hpp"
+#include "kernel.hpp"
+
+constexpr size_t BENCH_SZ = 1 << 22; // Symbols per run
+constexpr int BENCH_ROUNDS = 3;      // Best of
+
+
+template <typename F>
+double best_ms(F&& f)
+{
+    double best = 1e30;
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        if (!f()) return -1;
+        const auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    return best;
+}
+
+
+// Halving counts give code lengths 1, 2, ..., symCnt - 1, so symCnt sets the code length bound
+void run(uint8_t c, size_t symCnt)
+{
+    const size_t sz = BENCH_SZ - BENCH_SZ % c;
+    std::vector<uint8_t> data(sz), back(sz);
+    for (size_t i = 0, s = 0, left = sz / 2; i < sz; i++)
+    {
+        while (!left && s + 1 < symCnt) left = sz >> (++s + 1);
+        data[i] = static_cast<uint8_t>(s * 5);
+        if (left) left--;
+    }
+    std::shuffle(data.begin(), data.end(), std::mt19937(42));
+
+    std::fill_n(g_freq, COLOR_DEPTH, 0ULL);
+    for (uint8_t v : data) g_freq[v]++;
+    std::fill_n(g_codes, COLOR_DEPTH, Code{0, 0});
+    Node* root = build_tree(nullptr);
+    get_codes(root, 0, 0);
+    size_t maxLen = 0;
+    for (const Code& code : g_codes) maxLen = std::max(maxLen, code.len);
+
+    std::vector<uint8_t> buf(sz * 4 + 16);
+    size_t bytes = 0;
+    const double encGen = best_ms([&] { BitStream bs(buf.data(), buf.size()); return comp(&bs, data.data(), sz) && (bytes = bs.flush()); });
+    const double encK = best_ms([&] { BitStream bs(buf.data(), buf.size()); return comp_px(&bs, data.data(), sz, c) && bs.flush() == bytes; });
+
+    DecTable* tab = new DecTable;
+    dec_table(root, tab);
+    const double decGen = best_ms([&] { BitStream bs(buf.data(), bytes); return extr(&bs, back.data(), sz, root); });
+    const double decK = best_ms([&] { BitStream bs(buf.data(), bytes); return extr_px(&bs, back.data(), sz, c, root, tab); });
+    const bool same = data == back;
+    const unsigned bits = tab->bits;
+    delete tab;
+
+    const double mb = static_cast<double>(sz) / 1e6;
+    std::cout << std::fixed << std::setprecision(1)
+              << "  C=" << static_cast<int>(c) << "  maxLen=" << std::setw(2) << maxLen << " (L=" << std::setw(2) << bits << ")"
+              << "  encode " << std::setw(7) << mb / encGen * 1e3 << " -> " << std::setw(7) << mb / encK * 1e3 << " MB/s (x"
+              << std::setprecision(2) << encGen / encK << ")" << std::setprecision(1)
+              << "  decode " << std::setw(7) << mb / decGen * 1e3 << " -> " << std::setw(7) << mb / decK * 1e3 << " MB/s (x"
+              << std::setprecision(2) << decGen / decK << ")" << (same ? "" : "  MISMATCH") << std::endl;
+}
+
+
+int main()
+{
+    std::cout << "Generic comp()/extr() -> specialized comp_px()/extr_px(), " << BENCH_SZ << " symbols, best of " << BENCH_ROUNDS << std::endl;
+    for (uint8_t c = 1; c <= 4; c++)
+    {
+        run(c, 8);  // 8-bit lookup
+        run(c, 12); // 12-bit lookup
+        run(c, 16); // 16-bit lookup
+        run(c, 20); // Too deep for a lookup, tree walk
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string_view>
+
+#include "huffman.hpp"
+
+constexpr std::string_view STREAM_MAGIC = "HUFSTR";
+constexpr size_t ADPT_BLOCK = 64 * 1024;   // Default symbols per block
+constexpr size_t ADPT_BLOCK_MAX = 64 << 20; // Largest block either side accepts, bounds the decoder's buffers
+constexpr uint64_t ADPT_LIMIT = 1ULL << 20; // Counts are halved past this, keeps codes short and adaptive
+
+// Both ends start from a flat prior and rebuild the table after every block from the
+// counts seen so far, so the decoder mirrors the encoder without any side information
+struct AdaptiveModel
+{
+    uint64_t freq[COLOR_DEPTH];
+    uint64_t total;
+    Code codes[COLOR_DEPTH];
+    Node pool[COLOR_DEPTH * 2];
+    Node* root;
+};
+
+bool adpt_init(AdaptiveModel* m);
+bool adpt_update(AdaptiveModel* m, const uint8_t* data, size_t sz);
+
+bool stream_encode(std::istream& in, std::ostream& out, size_t block);
+bool stream_decode(std::istream& in, std::ostream& out);
@@ -23,6 +23,8 @@ struct BitStream
         // reader methods never write back into buf
 
     size_t flush();
+    size_t tell() const { return bytePos * 8 + bitPos; } // Absolute bit position
+    bool seek(size_t bit); // Reader only
     // Writer
     bool w(bool bit);
     bool wbits(uint64_t bits, size_t count);
@@ -35,5 +37,13 @@ struct BitStream
 bool comp(BitStream* bs, const uint8_t* data, size_t sz);
 bool extr(BitStream* bs, uint8_t* data, size_t sz, const Node* root);
 
-void put_u32(std::ofstream& out, uint32_t value);
-uint32_t get_u32(const uint8_t buf[4]);
\ No newline at end of file
+// Checkpointed payload: marks[i] is the bit length of segment i, every segment but the last
+// holds exactly `step` symbols, so segment starts are prefix sums of marks. `c` is the channel count
+bool comp_ckpt(BitStream* bs, const uint8_t* data, size_t sz, size_t step, uint32_t* marks, size_t markCnt, uint8_t c);
+bool extr_par(const uint8_t* buf, size_t bufSz, uint8_t* data, size_t sz, const Node* root,
+              size_t step, const uint32_t* marks, size_t markCnt, uint8_t c);
+
+void put_u32(std::ostream& out, uint32_t value);
+uint32_t get_u32(const uint8_t buf[4]);
+void put_u64(std::ostream& out, uint64_t value);
+uint64_t get_u64(const uint8_t buf[8]);
\ No newline at end of file
@@ -19,9 +19,10 @@ struct Code
     size_t len;
 };
 
-extern uint64_t g_freq[COLOR_DEPTH];
-extern Node g_nodes[COLOR_DEPTH * 2];
-extern Code g_codes[COLOR_DEPTH];
+// Per-thread scratch arenas, so concurrent coders (serve workers) never share tables
+extern thread_local uint64_t g_freq[COLOR_DEPTH];
+extern thread_local Node g_nodes[COLOR_DEPTH * 2];
+extern thread_local Code g_codes[COLOR_DEPTH];
 
 struct MinHeap
 {
@@ -38,4 +39,7 @@ bool save(const Node* root, struct BitStream* bs);
 Node* load(struct BitStream* bs, Node* pool, size_t* cnt, size_t poolSz);
 
 Node* build_tree(size_t* outCount);
-void get_codes(const Node* root, uint64_t code, size_t len);
\ No newline at end of file
+void get_codes(const Node* root, uint64_t code, size_t len);
+// Payload bits for the counts `freq` coded with `codes`, 0 for a single-symbol table since that
+// decodes as a fill. `covers` tells whether every counted symbol has a code
+uint64_t table_bits(const uint64_t* freq, const Code* codes, bool* covers);
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bit_io.hpp"
+#include "huffman.hpp"
+
+constexpr size_t DEC_BITS_MAX = 16; // Longest code the lookup decoder handles
+constexpr size_t KERNEL_CHUNK = 12 * 1024; // Symbols per capacity check, a multiple of every channel count
+constexpr size_t EST_RUNS = 64;            // Runs the estimator samples, spread evenly over the buffer
+constexpr size_t EST_RUN = 1024;           // Bytes per sampled run
+
+// Lookup decoder: the next `bits` stream bits index straight to symbol | code length << 8
+struct DecTable
+{
+    uint8_t bits; // 8, 12 or 16; 0 when the tree is too deep and the generic walker is used
+    uint16_t ent[1 << DEC_BITS_MAX];
+};
+
+bool dec_table(const Node* root, DecTable* t);
+
+// Dispatchers: pick a kernel specialized on the channel count (header byte 16) and the
+// code length bound of the table, falling back to comp()/extr() when none applies
+bool comp_px(BitStream* bs, const uint8_t* data, size_t sz, uint8_t c);
+bool extr_px(BitStream* bs, uint8_t* data, size_t sz, uint8_t c, const Node* root, const DecTable* t);
+
+// Expected Huffman tree plus payload size in bytes for all of `data`, from the histogram of a sample. Clobbers
+// g_freq and g_nodes, callers rebuild their own table afterwards
+uint64_t est_bytes(const uint8_t* data, size_t sz);
+
+// Channel repacking with both strides known at compile time, e.g. repack<4, 3> drops alpha
+template <size_t S, size_t D>
+void repack(const uint8_t* src, uint8_t* dst, size_t pxCnt)
+{
+    static_assert(D <= S);
+    for (size_t i = 0; i < pxCnt; ++i, src += S, dst += D)
+    {
+        for (size_t k = 0; k < D; ++k) dst[k] = src[k];
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "huffman.hpp"
+
+constexpr std::string_view PACK_MAGIC = "HUFPAK";
+constexpr size_t PACK_HEAD_SZ = 24;
+constexpr size_t PACK_REC_SZ = 36;
+constexpr uint32_t PACK_OWN_TABLE = 0xFFFFFFFFu; // Entry carries its own tree
+
+struct PackEntry
+{
+    std::string_view name;
+    uint64_t off;   // Absolute offset of the entry data
+    uint32_t size;  // Entry data bytes
+    uint32_t w;
+    uint32_t h;
+    uint8_t c;
+    uint32_t table; // Shared table id or PACK_OWN_TABLE
+};
+
+struct PackWriter
+{
+    std::ofstream out;
+    uint64_t pos;
+    uint8_t shTree[1024];
+    size_t shTreeSz;
+    Code shCodes[COLOR_DEPTH];
+    bool hasShared;
+    std::vector<std::string> names;
+    std::vector<PackEntry> entries; // name views are filled in at pack_end
+};
+
+struct PackReader
+{
+    const uint8_t* base;
+    size_t sz;
+    uint32_t cnt;
+    const uint8_t* idx;   // cnt fixed-size records, sorted by name
+    const char* names;
+    size_t namesSz;
+    uint32_t tblCnt;
+    Node* pool;           // Shared trees, COLOR_DEPTH * 2 nodes each
+    Node** roots;
+    struct DecTable* tabs; // Lookup decoders for the shared trees
+};
+
+// Writer: `freq` is the histogram over every image, it seeds the shared table
+bool pack_begin(PackWriter* pw, const std::string& path, const uint64_t* freq);
+bool pack_add(PackWriter* pw, const std::string& name, uint32_t w, uint32_t h, uint8_t c, const uint8_t* px);
+bool pack_end(PackWriter* pw);
+
+// Reader, backed by a read-only mapping of the whole pack
+bool pack_open(PackReader* pr, const std::string& path);
+void pack_close(PackReader* pr);
+bool pack_entry(const PackReader* pr, size_t i, PackEntry* out);
+bool pack_find(const PackReader* pr, std::string_view name, PackEntry* out);
+bool pack_decode(const PackReader* pr, const PackEntry& e, uint8_t* px);
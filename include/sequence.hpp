@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "huffman.hpp"
+
+constexpr std::string_view SEQ_MAGIC = "HUFSEQ";
+constexpr size_t SEQ_HEAD_SZ = 34;
+constexpr uint32_t SEQ_KEY_EVERY = 30; // Default keyframe interval
+constexpr uint64_t SEQ_DRIFT = 256;    // Reuse a table costing at most 1/SEQ_DRIFT more than a fresh one
+
+// Frame type byte
+constexpr uint8_t SEQ_KEY = 0;   // Coded on its own
+constexpr uint8_t SEQ_DELTA = 1; // Coded as (frame - previous frame) mod 256
+
+struct SeqKey
+{
+    uint32_t frame;
+    uint64_t off;
+};
+
+struct SeqWriter
+{
+    std::ofstream out;
+    uint32_t w;
+    uint32_t h;
+    uint8_t c;
+    uint32_t keyEvery;
+    uint32_t cnt;
+    uint64_t pos;
+    uint8_t* prev; // Previous frame, the residual reference
+    uint8_t* res;
+    Code codes[COLOR_DEPTH]; // Table the last frame was coded with
+    bool hasTable;
+    std::vector<uint8_t> payload;
+    std::vector<SeqKey> keys;
+};
+
+struct SeqReader
+{
+    std::ifstream in;
+    uint32_t w;
+    uint32_t h;
+    uint8_t c;
+    uint32_t cnt;
+    uint32_t next; // Frame the next seq_read returns
+    uint8_t* prev;
+    Node pool[COLOR_DEPTH * 2];
+    Node* root;
+    struct DecTable* tab;
+    std::vector<uint8_t> payload;
+    std::vector<SeqKey> keys;
+};
+
+bool seq_begin(SeqWriter* sw, const std::string& path, uint32_t w, uint32_t h, uint8_t c, uint32_t keyEvery);
+bool seq_add(SeqWriter* sw, const uint8_t* px);
+bool seq_end(SeqWriter* sw); // Also releases the writer after a failed seq_add
+void seq_abort(SeqWriter* sw); // Releases the writer and closes the file without writing the index
+
+bool seq_open(SeqReader* sr, const std::string& path);
+void seq_close(SeqReader* sr);
+bool seq_read(SeqReader* sr, uint8_t* px);
+// Restarts from the nearest keyframe at or before `frame` and decodes up to it
+bool seq_seek(SeqReader* sr, uint32_t frame);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Request ops, one byte on the wire
+constexpr uint8_t OP_ENCODE = 'e';
+constexpr uint8_t OP_DECODE = 'd';
+constexpr uint8_t OP_PING = 'p';
+constexpr uint8_t OP_QUIT = 'q';
+
+constexpr size_t SERVE_PATH_MAX = 4096;
+
+// Runs one request on the calling worker thread, returns the CLI status code
+using ServeFn = int (*)(uint8_t op, const std::string& in, const std::string& out);
+
+// Blocks until a client sends OP_QUIT, returns false if the socket could not be set up or a
+// non-socket file already sits at `sockPath`
+bool serve_run(const std::string& sockPath, size_t workers, ServeFn fn);
+
+struct ServeConn
+{
+    int fd;
+};
+
+bool serve_connect(ServeConn* sc, const std::string& sockPath);
+void serve_disconnect(ServeConn* sc);
+// Returns the handler status code, or -1 when the connection failed
+int serve_call(ServeConn* sc, uint8_t op, const std::string& in, const std::string& out);
@@ -0,0 +1,162 @@
+#include "adaptive.hpp"
+#include "bit_io.hpp"
+#include "kernel.hpp"
+
+#include <algorithm>
+
+
+static bool rebuild(AdaptiveModel* m)
+{
+    std::copy(m->freq, m->freq + COLOR_DEPTH, g_freq);
+    size_t cnt = 0;
+    Node* root = build_tree(&cnt);
+    if (!root) return false;
+    std::fill_n(g_codes, COLOR_DEPTH, Code{0, 0});
+    get_codes(root, 0, 0);
+    std::copy(g_codes, g_codes + COLOR_DEPTH, m->codes);
+
+    // Move the tree out of the shared arena so it survives other coders touching g_nodes
+    std::copy(g_nodes, g_nodes + cnt, m->pool);
+    for (size_t i = 0; i < cnt; ++i)
+    {
+        if (m->pool[i].l) m->pool[i].l = m->pool + (m->pool[i].l - g_nodes);
+        if (m->pool[i].r) m->pool[i].r = m->pool + (m->pool[i].r - g_nodes);
+    }
+    m->root = m->pool + (root - g_nodes);
+    return true;
+}
+
+
+bool adpt_init(AdaptiveModel* m)
+{
+    std::fill_n(m->freq, COLOR_DEPTH, 1ULL); // Every symbol must stay codable
+    m->total = COLOR_DEPTH;
+    return rebuild(m);
+}
+
+
+bool adpt_update(AdaptiveModel* m, const uint8_t* data, size_t sz)
+{
+    for (size_t i = 0; i < sz; ++i) m->freq[data[i]]++;
+    m->total += sz;
+    while (m->total > ADPT_LIMIT)
+    {
+        m->total = 0;
+        for (size_t i = 0; i < COLOR_DEPTH; ++i)
+        {
+            m->freq[i] = (m->freq[i] + 1) / 2;
+            m->total += m->freq[i];
+        }
+    }
+    return rebuild(m);
+}
+
+
+static size_t read_full(std::istream& in, uint8_t* buf, size_t sz)
+{
+    size_t got = 0;
+    while (got < sz && in)
+    {
+        in.read(reinterpret_cast<char*>(buf + got), static_cast<std::streamsize>(sz - got));
+        got += static_cast<size_t>(in.gcount());
+    }
+    return got;
+}
+
+
+bool stream_encode(std::istream& in, std::ostream& out, size_t block)
+{
+    if (!block || block > ADPT_BLOCK_MAX) return false;
+    AdaptiveModel* m = new (std::nothrow) AdaptiveModel;
+    const size_t payloadSz = block * 8 + 16; // Codes never exceed 64 bits
+    uint8_t* data = new (std::nothrow) uint8_t[block];
+    uint8_t* payload = new (std::nothrow) uint8_t[payloadSz];
+    bool ok = m && data && payload && adpt_init(m);
+
+    // Layout: magic(6) | version(2) | block size(4), then blocks of symbol count(4) | payload length(4) | payload,
+    // closed by an empty block
+    if (ok)
+    {
+        out.write(STREAM_MAGIC.data(), static_cast<std::streamsize>(STREAM_MAGIC.size()));
+        const uint8_t version[2] = {0x01, 0x00};
+        out.write(reinterpret_cast<const char*>(version), 2);
+        put_u32(out, static_cast<uint32_t>(block));
+    }
+    while (ok)
+    {
+        const size_t n = read_full(in, data, block);
+        if (!n) break;
+
+        std::copy(m->codes, m->codes + COLOR_DEPTH, g_codes);
+        BitStream payloadWrt(payload, payloadSz);
+        ok = comp_px(&payloadWrt, data, n, 1);
+        const size_t payloadBytes = payloadWrt.flush();
+        put_u32(out, static_cast<uint32_t>(n));
+        put_u32(out, static_cast<uint32_t>(payloadBytes));
+        out.write(reinterpret_cast<const char*>(payload), static_cast<std::streamsize>(payloadBytes));
+        out.flush(); // Latency is bounded by one block
+        ok = ok && out && adpt_update(m, data, n);
+        if (n < block) break;
+    }
+    if (ok)
+    {
+        put_u32(out, 0);
+        put_u32(out, 0);
+        ok = static_cast<bool>(out.flush());
+    }
+
+    if (payload) delete[] payload;
+    if (data) delete[] data;
+    if (m) delete m;
+    return ok;
+}
+
+
+bool stream_decode(std::istream& in, std::ostream& out)
+{
+    uint8_t head[12];
+    if (read_full(in, head, sizeof(head)) != sizeof(head)) return false;
+    if (std::string_view(reinterpret_cast<char*>(head), STREAM_MAGIC.size()) != STREAM_MAGIC) return false;
+    if (head[6] != 0x01 || head[7] != 0x00) return false;
+    const size_t block = get_u32(head + 8);
+    if (!block || block > ADPT_BLOCK_MAX) return false; // Never let a header size the buffers past the encoder's limit
+
+    AdaptiveModel* m = new (std::nothrow) AdaptiveModel;
+    const size_t payloadSz = block * 8 + 16;
+    uint8_t* data = new (std::nothrow) uint8_t[block];
+    uint8_t* payload = new (std::nothrow) uint8_t[payloadSz];
+    DecTable* tab = new (std::nothrow) DecTable; // Only the decoder needs it, rebuilt with every table
+    bool ok = m && data && payload && tab && adpt_init(m) && dec_table(m->root, tab);
+    while (ok)
+    {
+        uint8_t sizeBuf[8];
+        if (read_full(in, sizeBuf, 8) != 8)
+        {
+            ok = false; // Truncated before the closing block
+            break;
+        }
+        const size_t n = get_u32(sizeBuf), bytes = get_u32(sizeBuf + 4);
+        if (!n) break;
+        if (n > block || bytes > payloadSz || read_full(in, payload, bytes) != bytes)
+        {
+            ok = false;
+            break;
+        }
+
+        BitStream payloadRder(payload, bytes);
+        if (!extr_px(&payloadRder, data, n, 1, m->root, tab))
+        {
+            ok = false;
+            break;
+        }
+        out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(n));
+        out.flush();
+        ok = out && adpt_update(m, data, n) && dec_table(m->root, tab);
+    }
+
+    if (tab) delete tab;
+    if (payload) delete[] payload;
+    if (data) delete[] data;
+    if (m) delete m;
+    return ok;
+}
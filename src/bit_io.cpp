@@ -1,4 +1,10 @@
 #include "bit_io.hpp"
+#include "kernel.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
 
 bool BitStream::w(bool b)
 {
@@ -35,6 +41,15 @@ size_t BitStream::flush()
     return bytePos;
 }
 
+bool BitStream::seek(size_t bit)
+{
+    if (bit > sz * 8) return false;
+    bytePos = bit / 8;
+    bitPos = static_cast<uint8_t>(bit % 8);
+    curByte = bitPos ? buf[bytePos] : 0;
+    return true;
+}
+
 bool BitStream::r(bool* outBit)
 {
     if (bitPos == 0)
@@ -98,7 +113,81 @@ bool extr(BitStream* bs, uint8_t* data, size_t sz, const Node* root)
     return true;
 }
 
-void put_u32(std::ofstream& out, uint32_t value)
+bool comp_ckpt(BitStream* bs, const uint8_t* data, size_t sz, size_t step, uint32_t* marks, size_t markCnt, uint8_t c)
+{
+    if (!bs || !data || !step) return false;
+    size_t seg = 0;
+    for (size_t i = 0; i < sz; i += step)
+    {
+        const size_t n = std::min(step, sz - i);
+        const size_t at = bs->tell();
+        if (!comp_px(bs, data + i, n, c)) return false;
+        if (i + n == sz) break; // Last segment runs to the end of the payload
+
+        const size_t bits = bs->tell() - at;
+        if (seg >= markCnt || bits > 0xFFFFFFFFu) return false;
+        marks[seg++] = static_cast<uint32_t>(bits);
+    }
+    return seg == markCnt;
+}
+
+
+bool extr_par(const uint8_t* buf, size_t bufSz, uint8_t* data, size_t sz, const Node* root,
+              size_t step, const uint32_t* marks, size_t markCnt, uint8_t c)
+{
+    if (!buf || !data || !root || !step) return false;
+    const size_t segCnt = markCnt + 1;
+    if ((sz + step - 1) / step != segCnt) return false;
+    if (!root->l && !root->r)
+    {
+        std::memset(data, root->v, sz); // A lone symbol reads no bits, whatever the marks say
+        return true;
+    }
+
+    std::vector<size_t> starts(segCnt + 1);
+    starts[0] = 0;
+    for (size_t i = 0; i < markCnt; i++) starts[i + 1] = starts[i] + marks[i];
+    starts[segCnt] = bufSz * 8;
+    if (starts[markCnt] > bufSz * 8) return false;
+
+    DecTable* tab = new (std::nothrow) DecTable; // Built once, read by every worker
+    if (!tab || !dec_table(root, tab))
+    {
+        if (tab) delete tab;
+        return false;
+    }
+
+    const size_t hw = std::max<size_t>(1, std::thread::hardware_concurrency());
+    const size_t thrCnt = std::min(hw, segCnt);
+
+    // Each worker takes a contiguous run of segments, so it seeks once and decodes straight through
+    std::vector<uint8_t> ok(thrCnt, 0);
+    auto work = [&](size_t t)
+    {
+        const size_t first = segCnt * t / thrCnt, last = segCnt * (t + 1) / thrCnt;
+        BitStream bs(buf, bufSz);
+        if (!bs.seek(starts[first])) return;
+        for (size_t s = first; s < last; s++)
+        {
+            if (bs.tell() != starts[s]) return; // Index disagrees with the payload
+            const size_t beg = s * step, n = std::min(step, sz - beg);
+            if (!extr_px(&bs, data + beg, n, c, root, tab)) return;
+        }
+        if (last < segCnt && bs.tell() != starts[last]) return;
+        ok[t] = 1;
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t t = 1; t < thrCnt; t++) pool.emplace_back(work, t);
+    work(0);
+    for (auto& th : pool) th.join();
+    delete tab;
+
+    return std::all_of(ok.begin(), ok.end(), [](uint8_t v) { return v != 0; });
+}
+
+
+void put_u32(std::ostream& out, uint32_t value)
 {
     uint8_t buf[4] = {
         static_cast<uint8_t>(value & 0xFF),
@@ -111,4 +200,15 @@ void put_u32(std::ofstream& out, uint32_t value)
 uint32_t get_u32(const uint8_t buf[4])
 {
     return buf[0]|(buf[1] << 8)|(buf[2] << 16)|(buf[3] << 24);
+}
+
+void put_u64(std::ostream& out, uint64_t value)
+{
+    put_u32(out, static_cast<uint32_t>(value & 0xFFFFFFFFu));
+    put_u32(out, static_cast<uint32_t>(value >> 32));
+}
+
+uint64_t get_u64(const uint8_t buf[8])
+{
+    return static_cast<uint64_t>(get_u32(buf)) | (static_cast<uint64_t>(get_u32(buf + 4)) << 32);
 }
\ No newline at end of file
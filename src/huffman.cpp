@@ -1,9 +1,9 @@
 #include "huffman.hpp"
 #include "bit_io.hpp"
 
-uint64_t g_freq[COLOR_DEPTH];
-Node g_nodes[COLOR_DEPTH * 2];
-Code g_codes[COLOR_DEPTH];
+thread_local uint64_t g_freq[COLOR_DEPTH];
+thread_local Node g_nodes[COLOR_DEPTH * 2];
+thread_local Code g_codes[COLOR_DEPTH];
 
 
 void MinHeap::push(Node* x)
@@ -151,3 +151,20 @@ void get_codes(const Node* root, uint64_t code, size_t len)
     get_codes(root->l, (code << 1), len + 1);
     get_codes(root->r, (code << 1) | 1ULL, len + 1);
 }
+
+
+uint64_t table_bits(const uint64_t* freq, const Code* codes, bool* covers)
+{
+    uint64_t bits = 0;
+    size_t used = 0;
+    bool ok = true;
+    for (size_t i = 0; i < COLOR_DEPTH; ++i)
+    {
+        if (codes[i].len) used++;
+        if (!freq[i]) continue;
+        if (!codes[i].len) ok = false;
+        bits += freq[i] * codes[i].len;
+    }
+    if (covers) *covers = ok;
+    return used == 1 ? 0 : bits;
+}
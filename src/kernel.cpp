@@ -0,0 +1,257 @@
+#include "kernel.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+static size_t depth(const Node* n)
+{
+    if (!n->l && !n->r) return 0;
+    return 1 + std::max(depth(n->l), depth(n->r));
+}
+
+static void fill(const Node* n, uint32_t code, size_t len, DecTable* t)
+{
+    if (!n->l && !n->r)
+    {
+        const size_t sh = t->bits - len;
+        const uint16_t e = static_cast<uint16_t>(n->v | (len << 8));
+        std::fill(t->ent + (static_cast<size_t>(code) << sh), t->ent + (static_cast<size_t>(code + 1) << sh), e);
+        return;
+    }
+    fill(n->l, code << 1, len + 1, t);
+    fill(n->r, (code << 1) | 1, len + 1, t);
+}
+
+bool dec_table(const Node* root, DecTable* t)
+{
+    if (!root || !t) return false;
+    t->bits = 0;
+    const size_t d = depth(root);
+    if (d == 0 || d > DEC_BITS_MAX) return true; // Single leaf or too deep, extr_px walks the tree
+    t->bits = d <= 8 ? 8 : d <= 12 ? 12 : 16;
+    fill(root, 0, 0, t);
+    return true;
+}
+
+
+static uint64_t cost(const Node* n)
+{
+    if (!n->l && !n->r) return 0;
+    return n->f + cost(n->l) + cost(n->r); // Each internal node adds one bit to every symbol below it
+}
+
+uint64_t est_bytes(const uint8_t* data, size_t sz)
+{
+    if (!data || !sz) return 0;
+    std::fill_n(g_freq, COLOR_DEPTH, 0ULL);
+    size_t seen = 0;
+    if (sz <= EST_RUNS * EST_RUN)
+    {
+        for (size_t i = 0; i < sz; ++i) g_freq[data[i]]++;
+        seen = sz;
+    }
+    else
+    {
+        const size_t stride = sz / EST_RUNS;
+        for (size_t k = 0; k < EST_RUNS; ++k)
+        {
+            const uint8_t* run = data + k * stride;
+            for (size_t i = 0; i < EST_RUN; ++i) g_freq[run[i]]++;
+        }
+        seen = EST_RUNS * EST_RUN;
+    }
+    size_t used = 0;
+    const Node* root = build_tree(&used);
+    if (!root) return 0;
+    const uint64_t bits = std::max<uint64_t>(cost(root), seen); // A lone symbol still takes one bit
+    const uint64_t trBytes = (used * 10 + 7) / 8;                // Leaf: flag + value, internal: flag
+    return trBytes + static_cast<uint64_t>(static_cast<double>(bits) * static_cast<double>(sz) / static_cast<double>(seen) / 8.0);
+}
+
+
+// Encoder: every code fits in L bits. When a whole pixel fits the accumulator the drain runs once per
+// pixel, and output capacity is checked once per chunk instead of per bit
+template <size_t C, size_t L>
+static bool comp_k(BitStream* bs, const uint8_t* data, size_t sz, size_t maxLen)
+{
+    uint8_t* out = bs->buf + bs->bytePos;
+    uint64_t acc = bs->curByte >> (8 - bs->bitPos);
+    size_t nbits = bs->bitPos;
+    bool bad = false;
+    const auto put = [&](uint8_t p)
+    {
+        const Code& code = g_codes[p];
+        bad |= code.len == 0;
+        acc = (acc << code.len) | code.bs;
+        nbits += code.len;
+    };
+    const auto drain = [&]
+    {
+        while (nbits >= 8)
+        {
+            nbits -= 8;
+            *out++ = static_cast<uint8_t>(acc >> nbits);
+        }
+    };
+    const auto sync = [&]
+    {
+        bs->bytePos = static_cast<size_t>(out - bs->buf);
+        bs->bitPos = static_cast<uint8_t>(nbits);
+        bs->curByte = nbits ? static_cast<uint8_t>(acc << (8 - nbits)) : 0;
+    };
+
+    for (size_t beg = 0; beg < sz; beg += KERNEL_CHUNK)
+    {
+        const size_t end = std::min(sz, beg + KERNEL_CHUNK);
+        if ((bs->sz - static_cast<size_t>(out - bs->buf)) * 8 < (end - beg) * maxLen + 16)
+        {
+            // Near the end of the buffer comp() goes on bit by bit and reports an overflow exactly
+            sync();
+            return comp(bs, data + beg, sz - beg) && !bad;
+        }
+        for (size_t i = beg; i < end; i += C)
+        {
+            if constexpr (C * L <= 56)
+            {
+                for (size_t k = 0; k < C; ++k) put(data[i + k]);
+                drain();
+            }
+            else
+            {
+                for (size_t k = 0; k < C; ++k)
+                {
+                    put(data[i + k]);
+                    drain();
+                }
+            }
+        }
+    }
+    sync();
+    return !bad;
+}
+
+
+// Decoder: MSB-aligned 64-bit window. With C * L <= 56 one refill covers the whole pixel
+template <size_t C, size_t L>
+static bool extr_k(BitStream* bs, uint8_t* data, size_t sz, const DecTable* t)
+{
+    const uint8_t* buf = bs->buf;
+    const size_t bufSz = bs->sz;
+    size_t pos = bs->bytePos;
+    uint64_t acc = 0;
+    size_t nbits = 0;
+    if (bs->bitPos)
+    {
+        acc = static_cast<uint64_t>(static_cast<uint8_t>(bs->curByte << bs->bitPos)) << 56;
+        nbits = 8 - bs->bitPos;
+        pos++;
+    }
+
+    const auto refill = [&]
+    {
+        if (pos + 8 <= bufSz)
+        {
+            uint64_t v;
+            std::memcpy(&v, buf + pos, 8);
+            v = __builtin_bswap64(v);
+            acc |= v >> nbits;
+            pos += (63 - nbits) >> 3;
+            nbits |= 56;
+            return;
+        }
+        while (nbits <= 56) // Tail: pad with zeros, overruns are caught by the final position check
+        {
+            const uint64_t b = pos < bufSz ? buf[pos] : 0;
+            acc |= b << (56 - nbits);
+            nbits += 8;
+            pos++;
+        }
+    };
+    bool bad = false;
+    const auto get = [&]
+    {
+        const uint16_t e = t->ent[acc >> (64 - L)];
+        const size_t len = e >> 8;
+        bad |= len == 0;
+        acc <<= len;
+        nbits -= len;
+        return static_cast<uint8_t>(e);
+    };
+
+    for (size_t i = 0; i < sz; i += C)
+    {
+        if constexpr (C * L <= 56)
+        {
+            refill();
+            for (size_t k = 0; k < C; ++k) data[i + k] = get();
+        }
+        else
+        {
+            for (size_t k = 0; k < C; ++k)
+            {
+                refill();
+                data[i + k] = get();
+            }
+        }
+    }
+
+    const size_t end = pos * 8 - nbits;
+    if (bad || end > bufSz * 8) return false;
+    return bs->seek(end);
+}
+
+
+template <size_t C>
+static bool comp_c(BitStream* bs, const uint8_t* data, size_t sz, size_t maxLen)
+{
+    if (maxLen <= 8) return comp_k<C, 8>(bs, data, sz, maxLen);
+    if (maxLen <= 12) return comp_k<C, 12>(bs, data, sz, maxLen);
+    if (maxLen <= 16) return comp_k<C, 16>(bs, data, sz, maxLen);
+    if (maxLen <= 32) return comp_k<C, 32>(bs, data, sz, maxLen);
+    return comp(bs, data, sz);
+}
+
+bool comp_px(BitStream* bs, const uint8_t* data, size_t sz, uint8_t c)
+{
+    if (!bs || !data) return false;
+    size_t maxLen = 0;
+    for (size_t i = 0; i < COLOR_DEPTH; ++i) maxLen = std::max(maxLen, g_codes[i].len);
+    switch (c >= 1 && c <= 4 && sz % c == 0 ? c : 1)
+    {
+        case 2: return comp_c<2>(bs, data, sz, maxLen);
+        case 3: return comp_c<3>(bs, data, sz, maxLen);
+        case 4: return comp_c<4>(bs, data, sz, maxLen);
+        default: return comp_c<1>(bs, data, sz, maxLen);
+    }
+}
+
+
+template <size_t C>
+static bool extr_c(BitStream* bs, uint8_t* data, size_t sz, const DecTable* t)
+{
+    switch (t->bits)
+    {
+        case 8: return extr_k<C, 8>(bs, data, sz, t);
+        case 12: return extr_k<C, 12>(bs, data, sz, t);
+        default: return extr_k<C, 16>(bs, data, sz, t);
+    }
+}
+
+bool extr_px(BitStream* bs, uint8_t* data, size_t sz, uint8_t c, const Node* root, const DecTable* t)
+{
+    if (!bs || !data || !root) return false;
+    if (!root->l && !root->r)
+    {
+        std::memset(data, root->v, sz); // A lone symbol takes no payload bits
+        return true;
+    }
+    if (!t || !t->bits) return extr(bs, data, sz, root);
+    switch (c >= 1 && c <= 4 && sz % c == 0 ? c : 1)
+    {
+        case 2: return extr_c<2>(bs, data, sz, t);
+        case 3: return extr_c<3>(bs, data, sz, t);
+        case 4: return extr_c<4>(bs, data, sz, t);
+        default: return extr_c<1>(bs, data, sz, t);
+    }
+}
@@ -1,31 +1,62 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb/stb_image_write.h>
 
+#include "adaptive.hpp"
 #include "bit_io.hpp"
 #include "huffman.hpp"
+#include "kernel.hpp"
+#include "pack.hpp"
+#include "sequence.hpp"
+#include "serve.hpp"
 
 
 constexpr std::string_view USAGE =
     "Usage:\n"
     "  hufpix encode [input] [-o output]\n"
-    "  hufpix decode [input] [-o output]\n";
+    "  hufpix decode [input] [-o output]\n"
+    "  hufpix pack [inputs...] [-o output]\n"
+    "  hufpix list [input]\n"
+    "  hufpix extract [input] [name] [-o output]\n"
+    "  hufpix stream-encode [input|-] [-o output|-] [-b KiB]\n"
+    "  hufpix stream-decode [input|-] [-o output|-]\n"
+    "  hufpix seq [-k keyframe-interval] [frames...] [-o output]\n"
+    "  hufpix unseq [input] [-o output] [-f frame]\n"
+    "  hufpix serve [socket] [-j workers]\n"
+    "  hufpix client [socket] [encode|decode] [input] [-o output]\n"
+    "  hufpix client [socket] quit\n"
+    "  hufpix serve-bench [socket] [encode|decode|ping] [input] [-o output] [-n count]\n";
 constexpr std::string_view MAGIC = "HUFPIX";
 constexpr size_t TREE_SZ = 1024;
-
-int done_enc(int status, uint8_t* tree, uint8_t* payload, uint8_t* image)
+constexpr uint8_t FLAG_CKPT = 0x01; // Header byte 17: checkpoint index follows the payload
+constexpr uint8_t MODE_MASK = 0x06; // Header byte 17 bits 1-2: how the payload is stored
+constexpr uint8_t MODE_HUF = 0x00;  // Tree, then Huffman-coded pixels
+constexpr uint8_t MODE_RAW = 0x02;  // No tree, the pixels verbatim
+constexpr uint8_t MODE_FILL = 0x04; // No tree, one byte repeated over the whole image
+constexpr size_t RAW_MARGIN = 64;   // Huffman must save at least 1/RAW_MARGIN of the image to be used
+constexpr size_t CKPT_EVERY = 65536; // Pixels per checkpoint segment
+
+int done_enc(int status, uint8_t* tree, uint8_t* payload, uint8_t* image, uint32_t* marks = nullptr)
 {
+    if (marks) delete[] marks;
     if (payload) delete[] payload;
     if (tree) delete[] tree;
     if (image) stbi_image_free(image);
     return status;
 }
 
-int done_dec(int status, uint8_t* res, uint8_t* payload, uint8_t* trData)
+int done_dec(int status, uint8_t* res, uint8_t* payload, uint8_t* trData, uint32_t* marks = nullptr)
 {
+    if (marks) delete[] marks;
     if (res) delete[] res;
     if (payload) delete[] payload;
     if (trData) delete[] trData;
@@ -52,12 +83,7 @@ bool w_img(const std::string& path, int w, int h, int c, const uint8_t* data)
             if (pxCnt == 0) return false;
             uint8_t* rgb = new (std::nothrow) uint8_t[pxCnt * 3];
             if (!rgb) return false;
-            for (size_t i = 0; i < pxCnt; ++i)
-            {
-                rgb[i * 3 + 0] = data[i * 4 + 0];
-                rgb[i * 3 + 1] = data[i * 4 + 1];
-                rgb[i * 3 + 2] = data[i * 4 + 2];
-            }
+            repack<4, 3>(data, rgb, pxCnt);
             const bool ok = stbi_write_jpg(outPath, w, h, 3, rgb, 90) != 0;
             delete[] rgb;
             return ok;
@@ -73,35 +99,60 @@ int run_encode(const std::string& inPath, const std::string& outPath)
     uint8_t* image = stbi_load(inPath.c_str(), &w, &h, &c, 0);
     uint8_t* tree = nullptr;
     uint8_t* payload = nullptr;
-    if (!image) return done_enc(2, tree, payload, image);
+    uint32_t* marks = nullptr;
+    if (!image) return done_enc(2, tree, payload, image, marks);
 
     const size_t tot = static_cast<size_t>(w) * static_cast<size_t>(h) * static_cast<size_t>(c);
-    if (!tot || tot > (SIZE_MAX - 16) / 2) return done_enc(3, tree, payload, image);
-
-    std::fill_n(g_freq, COLOR_DEPTH, 0ULL);
-    for (size_t i = 0; i < tot; ++i) g_freq[image[i]]++;
+    if (!tot || tot > 0xFFFFFFFFu) return done_enc(3, tree, payload, image, marks); // A raw payload must fit its length field
 
-    Node* root = build_tree(nullptr);
-    if (!root) return done_enc(3, tree, payload, image);
-    get_codes(root, 0, 0);
+    // Pick the mode before any table work: one repeated value needs no table at all, and data the
+    // sampled histogram says Huffman cannot shrink is stored as is
+    uint8_t mode = MODE_HUF;
+    if (std::memcmp(image, image + 1, tot - 1) == 0) mode = MODE_FILL;
+    else if (est_bytes(image, tot) >= tot - tot / RAW_MARGIN) mode = MODE_RAW;
 
-    tree = new (std::nothrow) uint8_t[TREE_SZ];
-    if (!tree) return done_enc(4, tree, payload, image);
-    BitStream trWrt(tree, TREE_SZ);
-    if (!save(root, &trWrt)) return done_enc(4, tree, payload, image);
-    const size_t trBytes = trWrt.flush();
-    if (trBytes > 0xFFFFFFFFu) return done_enc(4, tree, payload, image);
-
-    const size_t payloadSz = tot * 2 + 16;
-    payload = new (std::nothrow) uint8_t[payloadSz];
-    if (!payload) return done_enc(4, tree, payload, image);
-    BitStream payloadWrt(payload, payloadSz);
-    if (!comp(&payloadWrt, image, tot)) return done_enc(4, tree, payload, image);
-    const size_t payloadBytes = payloadWrt.flush();
-    if (payloadBytes > 0xFFFFFFFFu) return done_enc(4, tree, payload, image);
+    size_t trBytes = 0, payloadBytes = 0, markCnt = 0;
+    if (mode == MODE_HUF)
+    {
+        std::fill_n(g_freq, COLOR_DEPTH, 0ULL);
+        for (size_t i = 0; i < tot; ++i) g_freq[image[i]]++;
+
+        Node* root = build_tree(nullptr);
+        if (!root) return done_enc(3, tree, payload, image, marks);
+        const bool leaf = !root->l && !root->r;
+        get_codes(root, 0, 0);
+
+        tree = new (std::nothrow) uint8_t[TREE_SZ];
+        if (!tree) return done_enc(4, tree, payload, image, marks);
+        BitStream trWrt(tree, TREE_SZ);
+        if (!save(root, &trWrt)) return done_enc(4, tree, payload, image, marks);
+        trBytes = trWrt.flush();
+
+        // No bigger than the image: a payload that does not fit is stored raw instead
+        payload = new (std::nothrow) uint8_t[tot];
+        if (!payload) return done_enc(4, tree, payload, image, marks);
+
+        // One mark per segment boundary, the decoder splits the payload there. A lone symbol decodes
+        // without reading any bits, so it gets no index
+        const size_t step = CKPT_EVERY * static_cast<size_t>(c);
+        markCnt = leaf ? 0 : (tot - 1) / step;
+        marks = markCnt ? new (std::nothrow) uint32_t[markCnt] : nullptr;
+        if (markCnt && !marks) return done_enc(4, tree, payload, image, marks);
+        BitStream payloadWrt(payload, tot);
+        const bool ok = comp_ckpt(&payloadWrt, image, tot, step, marks, markCnt, static_cast<uint8_t>(c));
+        payloadBytes = ok ? payloadWrt.flush() : 0;
+        if (!ok || trBytes + payloadBytes + (markCnt ? 8 + 4 * markCnt : 0) >= tot) mode = MODE_RAW;
+    }
+    if (mode != MODE_HUF)
+    {
+        trBytes = 0;
+        markCnt = 0;
+        payloadBytes = mode == MODE_FILL ? 1 : tot;
+    }
+    const uint8_t* body = mode == MODE_HUF ? payload : image;
 
     std::ofstream out(outPath, std::ios::binary);
-    if (!out) return done_enc(2, tree, payload, image);
+    if (!out) return done_enc(2, tree, payload, image, marks);
     auto put = [&](const void* ptr, size_t bytes)
     {
         out.write(reinterpret_cast<const char*>(ptr), static_cast<std::streamsize>(bytes));
@@ -109,7 +160,7 @@ int run_encode(const std::string& inPath, const std::string& outPath)
     };
 
     uint8_t header[18] = {};
-    // Layout: magic(6) | version(2) | width(4) | height(4) | channels(1) | padding
+    // Layout: magic(6) | version(2) | width(4) | height(4) | channels(1) | flags(1)
     std::copy(MAGIC.begin(), MAGIC.end(), header);
     header[6] = 0x01;
     const auto w_dim = [&](int value, int offset)
@@ -123,16 +174,26 @@ int run_encode(const std::string& inPath, const std::string& outPath)
     w_dim(w, 8);
     w_dim(h, 12);
     header[16] = static_cast<uint8_t>(c);
+    header[17] = static_cast<uint8_t>(mode | (markCnt ? FLAG_CKPT : 0));
 
-    if (!put(header, sizeof(header))) return done_enc(4, tree, payload, image);
+    if (!put(header, sizeof(header))) return done_enc(4, tree, payload, image, marks);
     put_u32(out, static_cast<uint32_t>(trBytes));
-    if (!out) return done_enc(4, tree, payload, image);
-    if (trBytes && !put(tree, trBytes)) return done_enc(4, tree, payload, image);
+    if (!out) return done_enc(4, tree, payload, image, marks);
+    if (trBytes && !put(tree, trBytes)) return done_enc(4, tree, payload, image, marks);
     put_u32(out, static_cast<uint32_t>(payloadBytes));
-    if (!out) return done_enc(4, tree, payload, image);
-    if (payloadBytes && !put(payload, payloadBytes)) return done_enc(4, tree, payload, image);
+    if (!out) return done_enc(4, tree, payload, image, marks);
+    if (payloadBytes && !put(body, payloadBytes)) return done_enc(4, tree, payload, image, marks);
 
-    return done_enc(0, tree, payload, image);
+    if (markCnt)
+    {
+        // Index: interval in pixels(4) | mark count(4) | segment bit lengths(4 * count)
+        put_u32(out, static_cast<uint32_t>(CKPT_EVERY));
+        put_u32(out, static_cast<uint32_t>(markCnt));
+        for (size_t i = 0; i < markCnt; i++) put_u32(out, marks[i]);
+        if (!out) return done_enc(4, tree, payload, image, marks);
+    }
+
+    return done_enc(0, tree, payload, image, marks);
 }
 
 
@@ -159,11 +220,30 @@ int run_decode(const std::string& inPath, const std::string& outPath)
     const uint32_t w = r_dim(8);
     const uint32_t h = r_dim(12);
     const uint8_t c = header[16];
+    const uint8_t flags = header[17];
     if (!w || !h || !c) return 3;
+    const uint8_t mode = flags & MODE_MASK;
+    if (flags & ~(FLAG_CKPT | MODE_MASK)) return 3;
+    if (mode != MODE_HUF && mode != MODE_RAW && mode != MODE_FILL) return 3;
+    if (mode != MODE_HUF && (flags & FLAG_CKPT)) return 3;
+    const size_t tot = static_cast<size_t>(w) * static_cast<size_t>(h) * static_cast<size_t>(c);
 
     uint8_t sizeBuf[4];
     if (!in.read(reinterpret_cast<char*>(sizeBuf), 4)) return 5;
     treeSz = get_u32(sizeBuf);
+    if (mode != MODE_HUF)
+    {
+        // Stored pixels land straight in the output buffer, a fill is a single memset
+        if (treeSz || !in.read(reinterpret_cast<char*>(sizeBuf), 4)) return 3;
+        payloadSz = get_u32(sizeBuf);
+        if (payloadSz != (mode == MODE_RAW ? tot : 1)) return 3;
+        res = new (std::nothrow) uint8_t[tot];
+        if (!res) return 4;
+        if (!in.read(reinterpret_cast<char*>(res), static_cast<std::streamsize>(payloadSz))) return done_dec(5, res, payload, trData);
+        if (mode == MODE_FILL) std::memset(res, res[0], tot);
+        if (!w_img(outPath, static_cast<int>(w), static_cast<int>(h), c, res)) return done_dec(4, res, payload, trData);
+        return done_dec(0, res, payload, trData);
+    }
     if (!treeSz) return 3;
 
     trData = new (std::nothrow) uint8_t[treeSz];
@@ -177,35 +257,362 @@ int run_decode(const std::string& inPath, const std::string& outPath)
     if (!payload) return done_dec(5, res, payload, trData);
     if (!in.read(reinterpret_cast<char*>(payload), static_cast<std::streamsize>(payloadSz))) return done_dec(5, res, payload, trData);
 
+    uint32_t* marks = nullptr;
+    uint32_t every = 0, markCnt = 0;
+    if (flags & FLAG_CKPT)
+    {
+        if (!in.read(reinterpret_cast<char*>(sizeBuf), 4)) return done_dec(5, res, payload, trData);
+        every = get_u32(sizeBuf);
+        if (!in.read(reinterpret_cast<char*>(sizeBuf), 4)) return done_dec(5, res, payload, trData);
+        markCnt = get_u32(sizeBuf);
+        // The count must match the image before it sizes an allocation
+        if (!every || !markCnt || markCnt != (tot - 1) / (static_cast<size_t>(every) * c)) return done_dec(3, res, payload, trData);
+        marks = new (std::nothrow) uint32_t[markCnt];
+        if (!marks) return done_dec(5, res, payload, trData);
+        for (uint32_t i = 0; i < markCnt; i++)
+        {
+            if (!in.read(reinterpret_cast<char*>(sizeBuf), 4)) return done_dec(5, res, payload, trData, marks);
+            marks[i] = get_u32(sizeBuf);
+        }
+    }
+
     BitStream trRder(trData, treeSz);
     size_t used = 0;
     Node* root = load(&trRder, g_nodes, &used, COLOR_DEPTH * 2); // Reuse the shared node arena
-    if (!root) return done_dec(3, res, payload, trData);
+    if (!root) return done_dec(3, res, payload, trData, marks);
 
-    const size_t tot = static_cast<size_t>(w) * static_cast<size_t>(h) * static_cast<size_t>(c);
-    if (!tot) return done_dec(3, res, payload, trData);
+    if (!tot) return done_dec(3, res, payload, trData, marks);
     res = new (std::nothrow) uint8_t[tot];
-    if (!res) return done_dec(4, res, payload, trData);
-    BitStream payloadRder(payload, payloadSz);
-    if (!extr(&payloadRder, res, tot, root)) return done_dec(3, res, payload, trData);
-    if (!w_img(outPath, static_cast<int>(w), static_cast<int>(h), c, res)) return done_dec(4, res, payload, trData);
+    if (!res) return done_dec(4, res, payload, trData, marks);
+    if (marks)
+    {
+        const size_t step = static_cast<size_t>(every) * c;
+        if (!extr_par(payload, payloadSz, res, tot, root, step, marks, markCnt, c)) return done_dec(3, res, payload, trData, marks);
+    }
+    else
+    {
+        DecTable* tab = new (std::nothrow) DecTable;
+        BitStream payloadRder(payload, payloadSz);
+        const bool ok = tab && dec_table(root, tab) && extr_px(&payloadRder, res, tot, c, root, tab);
+        if (tab) delete tab;
+        if (!ok) return done_dec(3, res, payload, trData);
+    }
+    if (!w_img(outPath, static_cast<int>(w), static_cast<int>(h), c, res)) return done_dec(4, res, payload, trData, marks);
+
+    return done_dec(0, res, payload, trData, marks);
+}
+
+
+std::string base_name(const std::string& path)
+{
+    const auto slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+
+int run_pack(char** inputs, int cnt, const std::string& outPath)
+{
+    // Entries are looked up by base name, so clashes are refused before any work is done
+    std::vector<std::string> names;
+    for (int i = 0; i < cnt; ++i) names.push_back(base_name(inputs[i]));
+    std::sort(names.begin(), names.end());
+    if (std::adjacent_find(names.begin(), names.end()) != names.end()) return 3;
+
+    // Pass 1 only gathers the batch histogram for the shared table, pass 2 encodes
+    uint64_t freq[COLOR_DEPTH] = {};
+    for (int i = 0; i < cnt; ++i)
+    {
+        int w = 0, h = 0, c = 0;
+        uint8_t* image = stbi_load(inputs[i], &w, &h, &c, 0);
+        if (!image) return 2;
+        const size_t tot = static_cast<size_t>(w) * static_cast<size_t>(h) * static_cast<size_t>(c);
+        for (size_t j = 0; j < tot; ++j) freq[image[j]]++;
+        stbi_image_free(image);
+    }
+
+    // Never leave a partial pack behind, list/extract could not open it
+    PackWriter pw;
+    const auto fail = [&](int status)
+    {
+        pw.out.close();
+        std::error_code ec;
+        std::filesystem::remove(outPath, ec);
+        return status;
+    };
+    if (!pack_begin(&pw, outPath, freq)) return fail(4);
+    for (int i = 0; i < cnt; ++i)
+    {
+        int w = 0, h = 0, c = 0;
+        uint8_t* image = stbi_load(inputs[i], &w, &h, &c, 0);
+        if (!image) return fail(2);
+        const bool ok = pack_add(&pw, base_name(inputs[i]), static_cast<uint32_t>(w), static_cast<uint32_t>(h),
+                                 static_cast<uint8_t>(c), image);
+        stbi_image_free(image);
+        if (!ok) return fail(4);
+    }
+    return pack_end(&pw) ? 0 : fail(4); // Names are already unique, only the write can fail
+}
+
+
+int run_list(const std::string& inPath)
+{
+    PackReader pr;
+    if (!pack_open(&pr, inPath)) return 2;
+    PackEntry e;
+    for (size_t i = 0; i < pr.cnt; ++i)
+    {
+        if (!pack_entry(&pr, i, &e))
+        {
+            pack_close(&pr);
+            return 3;
+        }
+        std::cout << e.name << "\t" << e.w << "x" << e.h << "x" << static_cast<int>(e.c) << "\t" << e.size << " bytes\t"
+                  << (e.table == PACK_OWN_TABLE ? "own" : "shared") << "\n";
+    }
+    pack_close(&pr);
+    return 0;
+}
+
+
+int run_extract(const std::string& inPath, const std::string& name, const std::string& outPath)
+{
+    PackReader pr;
+    if (!pack_open(&pr, inPath)) return 2;
+    PackEntry e;
+    if (!pack_find(&pr, name, &e))
+    {
+        pack_close(&pr);
+        return 3;
+    }
+    const size_t tot = static_cast<size_t>(e.w) * static_cast<size_t>(e.h) * static_cast<size_t>(e.c);
+    uint8_t* res = tot ? new (std::nothrow) uint8_t[tot] : nullptr;
+    int status = 0;
+    if (!res) status = 3;
+    else if (!pack_decode(&pr, e, res)) status = 3;
+    else if (!w_img(outPath, static_cast<int>(e.w), static_cast<int>(e.h), e.c, res)) status = 4;
+    if (res) delete[] res;
+    pack_close(&pr);
+    return status;
+}
+
+
+int run_seq(char** frames, int cnt, const std::string& outPath, uint32_t keyEvery)
+{
+    // A sequence that is known to be incomplete is never finalized, the partial file is removed
+    SeqWriter sw;
+    sw.prev = sw.res = nullptr;
+    bool begun = false; // Never remove a file this run did not create
+    const auto fail = [&](int status)
+    {
+        seq_abort(&sw);
+        std::error_code ec;
+        if (begun) std::filesystem::remove(outPath, ec);
+        return status;
+    };
+    int w0 = 0, h0 = 0, c0 = 0;
+    for (int i = 0; i < cnt; ++i)
+    {
+        int w = 0, h = 0, c = 0;
+        uint8_t* image = stbi_load(frames[i], &w, &h, &c, 0);
+        int status = image ? 0 : 2;
+        if (!status && i == 0)
+        {
+            w0 = w, h0 = h, c0 = c;
+            begun = true;
+            if (!seq_begin(&sw, outPath, static_cast<uint32_t>(w), static_cast<uint32_t>(h), static_cast<uint8_t>(c), keyEvery)) status = 4;
+        }
+        if (!status && (w != w0 || h != h0 || c != c0)) status = 3; // Every frame shares the first frame's layout
+        if (!status && !seq_add(&sw, image)) status = 4;
+        if (image) stbi_image_free(image);
+        if (status) return fail(status);
+    }
+    return seq_end(&sw) ? 0 : fail(4);
+}
+
+
+// frame_0007.png style names, the frame number goes in front of the extension
+std::string frame_path(const std::string& path, uint32_t frame)
+{
+    char num[16];
+    std::snprintf(num, sizeof(num), "_%04u", frame);
+    const auto dot = path.find_last_of('.');
+    const auto slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + num;
+    return path.substr(0, dot) + num + path.substr(dot);
+}
+
+
+int run_unseq(const std::string& inPath, const std::string& outPath, long frame)
+{
+    SeqReader sr;
+    if (!seq_open(&sr, inPath))
+    {
+        const int status = sr.in.is_open() ? 3 : 2; // seq_close() closes the stream
+        seq_close(&sr);
+        return status;
+    }
+    const size_t tot = static_cast<size_t>(sr.w) * static_cast<size_t>(sr.h) * static_cast<size_t>(sr.c);
+    uint8_t* res = new (std::nothrow) uint8_t[tot];
+    int status = res ? 0 : 4;
+    if (!status && frame >= 0)
+    {
+        // A single frame only decodes from its keyframe onwards
+        if (frame >= sr.cnt || !seq_seek(&sr, static_cast<uint32_t>(frame)) || !seq_read(&sr, res)) status = 3;
+        else if (!w_img(outPath, static_cast<int>(sr.w), static_cast<int>(sr.h), sr.c, res)) status = 4;
+    }
+    for (uint32_t i = 0; !status && frame < 0 && i < sr.cnt; ++i)
+    {
+        if (!seq_read(&sr, res)) status = 3;
+        else if (!w_img(frame_path(outPath, i), static_cast<int>(sr.w), static_cast<int>(sr.h), sr.c, res)) status = 4;
+    }
+    if (res) delete[] res;
+    seq_close(&sr);
+    return status;
+}
+
+
+int run_stream(bool enc, const std::string& inPath, const std::string& outPath, size_t block)
+{
+    // "-" selects stdin/stdout so frames can be piped through as they arrive
+    std::ifstream inFile;
+    std::ofstream outFile;
+    if (inPath != "-") inFile.open(inPath, std::ios::binary);
+    if (outPath != "-") outFile.open(outPath, std::ios::binary);
+    if ((inPath != "-" && !inFile) || (outPath != "-" && !outFile)) return 2;
+    std::istream& in = inPath == "-" ? std::cin : inFile;
+    std::ostream& out = outPath == "-" ? std::cout : outFile;
+
+    if (enc) return stream_encode(in, out, block) ? 0 : 4;
+    return stream_decode(in, out) ? 0 : 3;
+}
+
+
+int serve_req(uint8_t op, const std::string& in, const std::string& out)
+{
+    return op == OP_ENCODE ? run_encode(in, out) : run_decode(in, out);
+}
 
-    return done_dec(0, res, payload, trData);
+
+int run_serve(const std::string& sockPath, size_t workers)
+{
+    return serve_run(sockPath, workers, serve_req) ? 0 : 2;
+}
+
+
+uint8_t op_of(const std::string& mode)
+{
+    if (mode == "encode") return OP_ENCODE;
+    if (mode == "decode") return OP_DECODE;
+    if (mode == "ping") return OP_PING;
+    if (mode == "quit") return OP_QUIT;
+    return 0;
+}
+
+
+int run_client(const std::string& sockPath, uint8_t op, const std::string& inPath, const std::string& outPath)
+{
+    // The daemon has its own working directory, so relative paths are resolved here
+    std::error_code ec;
+    const std::string in = inPath.empty() ? inPath : std::filesystem::absolute(inPath, ec).string();
+    const std::string out = outPath.empty() ? outPath : std::filesystem::absolute(outPath, ec).string();
+    if (ec) return 2;
+
+    ServeConn sc;
+    if (!serve_connect(&sc, sockPath)) return 2;
+    const int status = serve_call(&sc, op, in, out);
+    serve_disconnect(&sc);
+    return status < 0 ? 2 : status;
+}
+
+
+int run_serve_bench(const std::string& sockPath, uint8_t op, const std::string& inPath, const std::string& outPath, size_t n)
+{
+    std::error_code ec;
+    const std::string in = std::filesystem::absolute(inPath, ec).string();
+    const std::string out = std::filesystem::absolute(outPath, ec).string();
+    if (ec) return 2;
+
+    ServeConn sc;
+    if (!serve_connect(&sc, sockPath)) return 2;
+    std::vector<double> lat(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        const auto t0 = std::chrono::steady_clock::now();
+        const int status = serve_call(&sc, op, in, out);
+        const auto t1 = std::chrono::steady_clock::now();
+        if (status != 0)
+        {
+            serve_disconnect(&sc);
+            return status < 0 ? 2 : status;
+        }
+        lat[i] = std::chrono::duration<double, std::micro>(t1 - t0).count();
+    }
+    serve_disconnect(&sc);
+
+    std::sort(lat.begin(), lat.end());
+    const auto pct = [&](size_t p) { return lat[std::min(n - 1, n * p / 100)]; };
+    std::cout << n << " requests, latency (us): p50 " << pct(50) << "  p90 " << pct(90) << "  p99 " << pct(99)
+              << "  max " << lat[n - 1] << std::endl;
+    return 0;
 }
 
 
 int main(int argc, char** argv)
 {
     uint8_t err = 0;
-    if (argc == 5)
+    const std::string mode = argc > 1 ? argv[1] : "";
+    if (argc == 5 && (mode == "encode" || mode == "decode"))
     {
-        const std::string mode = argv[1], input = argv[2], flag = argv[3], output = argv[4];
+        const std::string input = argv[2], flag = argv[3], output = argv[4];
 
         if (flag != "-o") err = 1;
         else if (mode == "encode") err = run_encode(input, output);
-        else if (mode == "decode") err = run_decode(input, output);
-        else err = 1;
+        else err = run_decode(input, output);
+    }
+    else if (argc >= 5 && mode == "pack" && std::string_view(argv[argc - 2]) == "-o") err = run_pack(argv + 2, argc - 4, argv[argc - 1]);
+    else if (argc == 3 && mode == "list") err = run_list(argv[2]);
+    else if (argc >= 5 && mode == "seq" && std::string_view(argv[argc - 2]) == "-o")
+    {
+        const bool hasKey = std::string_view(argv[2]) == "-k";
+        const long keyEvery = hasKey ? std::strtol(argv[3], nullptr, 10) : static_cast<long>(SEQ_KEY_EVERY);
+        const int first = hasKey ? 4 : 2;
+        if (keyEvery <= 0 || keyEvery > 0xFFFFFFFFL || argc - 2 <= first) err = 1;
+        else err = run_seq(argv + first, argc - 2 - first, argv[argc - 1], static_cast<uint32_t>(keyEvery));
+    }
+    else if ((argc == 5 || argc == 7) && mode == "unseq" && std::string_view(argv[3]) == "-o")
+    {
+        const long frame = argc == 7 ? std::strtol(argv[6], nullptr, 10) : -1;
+        if (argc == 7 && (std::string_view(argv[5]) != "-f" || frame < 0)) err = 1;
+        else err = run_unseq(argv[2], argv[4], frame);
+    }
+    else if ((argc == 3 || argc == 5) && mode == "serve")
+    {
+        const long jobs = argc == 5 ? std::strtol(argv[4], nullptr, 10) : static_cast<long>(std::thread::hardware_concurrency());
+        if (argc == 5 && std::string_view(argv[3]) != "-j") err = 1;
+        else err = run_serve(argv[2], static_cast<size_t>(std::clamp(jobs, 1L, 256L)));
+    }
+    else if (argc == 4 && mode == "client" && std::string_view(argv[3]) == "quit") err = run_client(argv[2], OP_QUIT, "", "");
+    else if (argc == 7 && mode == "client" && std::string_view(argv[5]) == "-o" &&
+             (op_of(argv[3]) == OP_ENCODE || op_of(argv[3]) == OP_DECODE)) err = run_client(argv[2], op_of(argv[3]), argv[4], argv[6]);
+    else if ((argc == 7 || argc == 9) && mode == "serve-bench" && std::string_view(argv[5]) == "-o" &&
+             op_of(argv[3]) && op_of(argv[3]) != OP_QUIT)
+    {
+        const long n = argc == 9 ? std::strtol(argv[8], nullptr, 10) : 1000;
+        if ((argc == 9 && std::string_view(argv[7]) != "-n") || n <= 0) err = 1;
+        else err = run_serve_bench(argv[2], op_of(argv[3]), argv[4], argv[6], static_cast<size_t>(n));
+    }
+    else if ((argc == 5 || argc == 7) && (mode == "stream-encode" || mode == "stream-decode") && std::string_view(argv[3]) == "-o")
+    {
+        size_t block = ADPT_BLOCK;
+        if (argc == 7)
+        {
+            const long kib = std::strtol(argv[6], nullptr, 10);
+            if (std::string_view(argv[5]) != "-b" || kib <= 0 || kib > static_cast<long>(ADPT_BLOCK_MAX / 1024) || mode != "stream-encode") block = 0;
+            else block = static_cast<size_t>(kib) * 1024;
+        }
+        err = block ? run_stream(mode == "stream-encode", argv[2], argv[4], block) : 1;
     }
+    else if (argc == 6 && mode == "extract" && std::string_view(argv[4]) == "-o") err = run_extract(argv[2], argv[3], argv[5]);
     else err = 1;
 
     switch (err)
@@ -0,0 +1,289 @@
+#include "pack.hpp"
+#include "bit_io.hpp"
+#include "kernel.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+bool pack_begin(PackWriter* pw, const std::string& path, const uint64_t* freq)
+{
+    pw->out.open(path, std::ios::binary | std::ios::trunc);
+    if (!pw->out) return false;
+    pw->names.clear();
+    pw->entries.clear();
+    pw->shTreeSz = 0;
+    pw->hasShared = false;
+    std::fill_n(pw->shCodes, COLOR_DEPTH, Code{0, 0});
+
+    // Shared table from the histogram of the whole batch, covers every symbol any entry uses
+    std::copy(freq, freq + COLOR_DEPTH, g_freq);
+    std::fill_n(g_codes, COLOR_DEPTH, Code{0, 0});
+    Node* root = build_tree(nullptr);
+    if (root)
+    {
+        get_codes(root, 0, 0);
+        BitStream trWrt(pw->shTree, sizeof(pw->shTree));
+        if (!save(root, &trWrt)) return false;
+        pw->shTreeSz = trWrt.flush();
+        std::copy(g_codes, g_codes + COLOR_DEPTH, pw->shCodes);
+        pw->hasShared = true;
+    }
+
+    // Layout: magic(6) | version(2) | entry count(4) | table count(4) | index offset(8)
+    uint8_t header[PACK_HEAD_SZ] = {};
+    std::copy(PACK_MAGIC.begin(), PACK_MAGIC.end(), header);
+    header[6] = 0x01;
+    header[12] = pw->hasShared ? 1 : 0;
+    pw->out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    pw->pos = PACK_HEAD_SZ;
+    if (pw->hasShared)
+    {
+        put_u32(pw->out, static_cast<uint32_t>(pw->shTreeSz));
+        pw->out.write(reinterpret_cast<const char*>(pw->shTree), static_cast<std::streamsize>(pw->shTreeSz));
+        pw->pos += 4 + pw->shTreeSz;
+    }
+    return static_cast<bool>(pw->out);
+}
+
+
+bool pack_add(PackWriter* pw, const std::string& name, uint32_t w, uint32_t h, uint8_t c, const uint8_t* px)
+{
+    const size_t tot = static_cast<size_t>(w) * static_cast<size_t>(h) * static_cast<size_t>(c);
+    if (!tot || !px || name.empty() || name.size() > 0xFFFFFFFFu) return false;
+
+    std::fill_n(g_freq, COLOR_DEPTH, 0ULL);
+    for (size_t i = 0; i < tot; ++i) g_freq[px[i]]++;
+    std::fill_n(g_codes, COLOR_DEPTH, Code{0, 0});
+    Node* root = build_tree(nullptr);
+    if (!root) return false;
+    get_codes(root, 0, 0);
+
+    uint8_t tree[1024];
+    BitStream trWrt(tree, sizeof(tree));
+    if (!save(root, &trWrt)) return false;
+    const size_t trBytes = trWrt.flush();
+
+    // Exact coded sizes are known from the histogram, so the cheaper table is picked before encoding
+    bool shOk = false;
+    const uint64_t ownBits = table_bits(g_freq, g_codes, nullptr);
+    const uint64_t shBits = pw->hasShared ? table_bits(g_freq, pw->shCodes, &shOk) : 0;
+    const bool useShared = shOk && (shBits + 7) / 8 <= 4 + trBytes + (ownBits + 7) / 8;
+    if (useShared) std::copy(pw->shCodes, pw->shCodes + COLOR_DEPTH, g_codes);
+
+    const uint64_t bits = useShared ? shBits : ownBits;
+    const size_t payloadSz = bits / 8 + 1;
+    uint8_t* payload = new (std::nothrow) uint8_t[payloadSz];
+    if (!payload) return false;
+    BitStream payloadWrt(payload, payloadSz);
+    const bool ok = !bits || comp_px(&payloadWrt, px, tot, c);
+    const size_t payloadBytes = bits ? payloadWrt.flush() : 0;
+    const uint64_t size = (useShared ? 0 : 4 + trBytes) + payloadBytes;
+    if (!ok || size > 0xFFFFFFFFu)
+    {
+        delete[] payload;
+        return false;
+    }
+
+    // Entry data: [tree length(4) | tree] when it has its own table, then the payload
+    if (!useShared)
+    {
+        put_u32(pw->out, static_cast<uint32_t>(trBytes));
+        pw->out.write(reinterpret_cast<const char*>(tree), static_cast<std::streamsize>(trBytes));
+    }
+    pw->out.write(reinterpret_cast<const char*>(payload), static_cast<std::streamsize>(payloadBytes));
+    delete[] payload;
+    if (!pw->out) return false;
+
+    pw->names.push_back(name);
+    pw->entries.push_back(PackEntry{{}, pw->pos, static_cast<uint32_t>(size), w, h, c,
+                                    useShared ? 0u : PACK_OWN_TABLE});
+    pw->pos += size;
+    return true;
+}
+
+
+bool pack_end(PackWriter* pw)
+{
+    const size_t cnt = pw->entries.size();
+    if (cnt > 0xFFFFFFFFu) return false;
+    std::vector<size_t> order(cnt);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return pw->names[a] < pw->names[b]; });
+    for (size_t i = 1; i < cnt; ++i)
+    {
+        if (pw->names[order[i - 1]] == pw->names[order[i]]) return false; // Lookup needs unique names
+    }
+
+    // Index: cnt records, then the string table they point into
+    // Record: name offset(4) | name length(4) | data offset(8) | data size(4) | width(4) | height(4) | channels(1) | padding(3) | table(4)
+    const uint64_t idxOff = pw->pos;
+    uint64_t nameOff = 0;
+    for (size_t i : order)
+    {
+        const PackEntry& e = pw->entries[i];
+        if (nameOff > 0xFFFFFFFFu) return false;
+        put_u32(pw->out, static_cast<uint32_t>(nameOff));
+        put_u32(pw->out, static_cast<uint32_t>(pw->names[i].size()));
+        put_u64(pw->out, e.off);
+        put_u32(pw->out, e.size);
+        put_u32(pw->out, e.w);
+        put_u32(pw->out, e.h);
+        const uint8_t pad[4] = {e.c, 0, 0, 0};
+        pw->out.write(reinterpret_cast<const char*>(pad), sizeof(pad));
+        put_u32(pw->out, e.table);
+        nameOff += pw->names[i].size();
+    }
+    for (size_t i : order) pw->out.write(pw->names[i].data(), static_cast<std::streamsize>(pw->names[i].size()));
+
+    pw->out.seekp(8);
+    put_u32(pw->out, static_cast<uint32_t>(cnt));
+    pw->out.seekp(16);
+    put_u64(pw->out, idxOff);
+    pw->out.close();
+    return !pw->out.fail();
+}
+
+
+bool pack_open(PackReader* pr, const std::string& path)
+{
+    *pr = PackReader{nullptr, 0, 0, nullptr, nullptr, 0, 0, nullptr, nullptr, nullptr};
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(PACK_HEAD_SZ))
+    {
+        ::close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps the file alive
+    if (map == MAP_FAILED) return false;
+    pr->base = static_cast<const uint8_t*>(map);
+    pr->sz = static_cast<size_t>(st.st_size);
+
+    const uint8_t* head = pr->base;
+    if (std::string_view(reinterpret_cast<const char*>(head), PACK_MAGIC.size()) != PACK_MAGIC ||
+        head[6] != 0x01 || head[7] != 0x00)
+    {
+        pack_close(pr);
+        return false;
+    }
+    pr->cnt = get_u32(head + 8);
+    pr->tblCnt = get_u32(head + 12);
+    const uint64_t idxOff = get_u64(head + 16);
+    if (idxOff > pr->sz || (pr->sz - idxOff) / PACK_REC_SZ < pr->cnt || pr->tblCnt > 0xFFFF)
+    {
+        pack_close(pr);
+        return false;
+    }
+    pr->idx = pr->base + idxOff;
+    pr->names = reinterpret_cast<const char*>(pr->idx + static_cast<size_t>(pr->cnt) * PACK_REC_SZ);
+    pr->namesSz = pr->sz - idxOff - static_cast<size_t>(pr->cnt) * PACK_REC_SZ;
+
+    // Shared trees are small and hot, so they are rebuilt once instead of per entry
+    pr->pool = new (std::nothrow) Node[static_cast<size_t>(pr->tblCnt) * COLOR_DEPTH * 2 + 1];
+    pr->roots = new (std::nothrow) Node*[pr->tblCnt + 1];
+    pr->tabs = new (std::nothrow) DecTable[pr->tblCnt + 1];
+    if (!pr->pool || !pr->roots || !pr->tabs)
+    {
+        pack_close(pr);
+        return false;
+    }
+    size_t pos = PACK_HEAD_SZ;
+    for (uint32_t t = 0; t < pr->tblCnt; ++t)
+    {
+        const uint32_t trSz = pos + 4 <= idxOff ? get_u32(pr->base + pos) : 0;
+        pos += 4;
+        size_t used = 0;
+        BitStream trRder(pr->base + pos, trSz);
+        pr->roots[t] = trSz && trSz <= idxOff - pos
+            ? load(&trRder, pr->pool + static_cast<size_t>(t) * COLOR_DEPTH * 2, &used, COLOR_DEPTH * 2)
+            : nullptr;
+        if (!pr->roots[t] || !dec_table(pr->roots[t], &pr->tabs[t]))
+        {
+            pack_close(pr);
+            return false;
+        }
+        pos += trSz;
+    }
+    return true;
+}
+
+
+void pack_close(PackReader* pr)
+{
+    if (pr->base) munmap(const_cast<uint8_t*>(pr->base), pr->sz);
+    if (pr->pool) delete[] pr->pool;
+    if (pr->roots) delete[] pr->roots;
+    if (pr->tabs) delete[] pr->tabs;
+    *pr = PackReader{nullptr, 0, 0, nullptr, nullptr, 0, 0, nullptr, nullptr, nullptr};
+}
+
+
+bool pack_entry(const PackReader* pr, size_t i, PackEntry* out)
+{
+    if (i >= pr->cnt) return false;
+    const uint8_t* rec = pr->idx + i * PACK_REC_SZ;
+    const uint32_t nameOff = get_u32(rec), nameLen = get_u32(rec + 4);
+    if (nameOff > pr->namesSz || nameLen > pr->namesSz - nameOff) return false;
+    out->name = std::string_view(pr->names + nameOff, nameLen);
+    out->off = get_u64(rec + 8);
+    out->size = get_u32(rec + 16);
+    out->w = get_u32(rec + 20);
+    out->h = get_u32(rec + 24);
+    out->c = rec[28];
+    out->table = get_u32(rec + 32);
+    if (out->off > pr->sz || out->size > pr->sz - out->off) return false;
+    return true;
+}
+
+
+bool pack_find(const PackReader* pr, std::string_view name, PackEntry* out)
+{
+    size_t lo = 0, hi = pr->cnt;
+    while (lo < hi)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (!pack_entry(pr, mid, out)) return false;
+        if (out->name < name) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < pr->cnt && pack_entry(pr, lo, out) && out->name == name;
+}
+
+
+bool pack_decode(const PackReader* pr, const PackEntry& e, uint8_t* px)
+{
+    const size_t tot = static_cast<size_t>(e.w) * static_cast<size_t>(e.h) * static_cast<size_t>(e.c);
+    if (!tot || !px) return false;
+    const uint8_t* data = pr->base + e.off;
+    const size_t dataSz = e.size;
+
+    if (e.table != PACK_OWN_TABLE)
+    {
+        if (e.table >= pr->tblCnt) return false;
+        BitStream payloadRder(data, dataSz);
+        return extr_px(&payloadRder, px, tot, e.c, pr->roots[e.table], &pr->tabs[e.table]);
+    }
+
+    if (dataSz < 4) return false;
+    const uint32_t trSz = get_u32(data);
+    if (trSz > dataSz - 4) return false;
+    Node pool[COLOR_DEPTH * 2];
+    BitStream trRder(data + 4, trSz);
+    size_t used = 0;
+    const Node* root = load(&trRder, pool, &used, COLOR_DEPTH * 2);
+    if (!root) return false;
+
+    DecTable* tab = new (std::nothrow) DecTable;
+    BitStream payloadRder(data + 4 + trSz, dataSz - 4 - trSz);
+    const bool ok = tab && dec_table(root, tab) && extr_px(&payloadRder, px, tot, e.c, root, tab);
+    if (tab) delete tab;
+    return ok;
+}
@@ -0,0 +1,268 @@
+#include "sequence.hpp"
+#include "bit_io.hpp"
+#include "kernel.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+bool seq_begin(SeqWriter* sw, const std::string& path, uint32_t w, uint32_t h, uint8_t c, uint32_t keyEvery)
+{
+    const size_t tot = static_cast<size_t>(w) * static_cast<size_t>(h) * static_cast<size_t>(c);
+    sw->prev = sw->res = nullptr;
+    if (!tot || !keyEvery) return false;
+    sw->w = w;
+    sw->h = h;
+    sw->c = c;
+    sw->keyEvery = keyEvery;
+    sw->cnt = 0;
+    sw->hasTable = false;
+    sw->keys.clear();
+    sw->prev = new (std::nothrow) uint8_t[tot];
+    sw->res = new (std::nothrow) uint8_t[tot];
+    if (!sw->prev || !sw->res) return false;
+
+    sw->out.open(path, std::ios::binary | std::ios::trunc);
+    if (!sw->out) return false;
+
+    // Layout: magic(6) | version(2) | width(4) | height(4) | channels(1) | reserved(1) | frame count(4)
+    //         | keyframe interval(4) | index offset(8); count and index offset are patched by seq_end
+    uint8_t header[SEQ_HEAD_SZ] = {};
+    std::copy(SEQ_MAGIC.begin(), SEQ_MAGIC.end(), header);
+    header[6] = 0x01;
+    const auto w_u32 = [&](uint32_t v, int offset)
+    {
+        for (int i = 0; i < 4; ++i) header[offset + i] = static_cast<uint8_t>((v >> (8 * i)) & 0xFF);
+    };
+    w_u32(w, 8);
+    w_u32(h, 12);
+    header[16] = c;
+    w_u32(keyEvery, 22);
+    sw->out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    sw->pos = SEQ_HEAD_SZ;
+    return static_cast<bool>(sw->out);
+}
+
+
+bool seq_add(SeqWriter* sw, const uint8_t* px)
+{
+    const size_t tot = static_cast<size_t>(sw->w) * static_cast<size_t>(sw->h) * static_cast<size_t>(sw->c);
+    if (!px || !sw->prev || sw->cnt == 0xFFFFFFFFu) return false;
+    const bool key = sw->cnt % sw->keyEvery == 0;
+
+    const uint8_t* src = px;
+    if (!key)
+    {
+        for (size_t i = 0; i < tot; ++i) sw->res[i] = static_cast<uint8_t>(px[i] - sw->prev[i]);
+        src = sw->res;
+    }
+
+    std::fill_n(g_freq, COLOR_DEPTH, 0ULL);
+    for (size_t i = 0; i < tot; ++i) g_freq[src[i]]++;
+    std::fill_n(g_codes, COLOR_DEPTH, Code{0, 0});
+    Node* root = build_tree(nullptr);
+    if (!root) return false;
+    get_codes(root, 0, 0);
+
+    uint8_t tree[1024];
+    BitStream trWrt(tree, sizeof(tree));
+    if (!save(root, &trWrt)) return false;
+    const size_t trBytes = trWrt.flush();
+
+    // Keep the previous table while the histogram has not drifted: it may cost slightly more than a
+    // fresh table plus its tree, but the decoder then skips the tree load and lookup rebuild. A static
+    // scene's residual has a single symbol, its table needs no payload
+    bool covers = false;
+    const uint64_t ownBits = table_bits(g_freq, g_codes, nullptr);
+    const uint64_t oldBits = sw->hasTable ? table_bits(g_freq, sw->codes, &covers) : 0;
+    bool reuse = !key && sw->hasTable && covers;
+    const uint64_t ownBytes = 4 + trBytes + (ownBits + 7) / 8;
+    reuse = reuse && (oldBits + 7) / 8 <= ownBytes + ownBytes / SEQ_DRIFT;
+    if (reuse) std::copy(sw->codes, sw->codes + COLOR_DEPTH, g_codes);
+    else std::copy(g_codes, g_codes + COLOR_DEPTH, sw->codes);
+    sw->hasTable = true;
+
+    const uint64_t bits = reuse ? oldBits : ownBits;
+    size_t payloadBytes = 0;
+    if (bits)
+    {
+        sw->payload.resize(bits / 8 + 1);
+        BitStream payloadWrt(sw->payload.data(), sw->payload.size());
+        if (!comp_px(&payloadWrt, src, tot, sw->c)) return false;
+        payloadBytes = payloadWrt.flush();
+    }
+
+    // Frame: type(1) | new table(1) | [tree length(4) | tree] | payload length(4) | payload
+    if (key) sw->keys.push_back(SeqKey{sw->cnt, sw->pos});
+    const uint8_t head[2] = {key ? SEQ_KEY : SEQ_DELTA, static_cast<uint8_t>(reuse ? 0 : 1)};
+    sw->out.write(reinterpret_cast<const char*>(head), 2);
+    sw->pos += 2;
+    if (!reuse)
+    {
+        put_u32(sw->out, static_cast<uint32_t>(trBytes));
+        sw->out.write(reinterpret_cast<const char*>(tree), static_cast<std::streamsize>(trBytes));
+        sw->pos += 4 + trBytes;
+    }
+    if (payloadBytes > 0xFFFFFFFFu) return false;
+    put_u32(sw->out, static_cast<uint32_t>(payloadBytes));
+    sw->out.write(reinterpret_cast<const char*>(sw->payload.data()), static_cast<std::streamsize>(payloadBytes));
+    sw->pos += 4 + payloadBytes;
+
+    std::memcpy(sw->prev, px, tot);
+    sw->cnt++;
+    return static_cast<bool>(sw->out);
+}
+
+
+bool seq_end(SeqWriter* sw)
+{
+    bool ok = sw->prev && sw->out.is_open();
+    if (sw->prev) delete[] sw->prev;
+    if (sw->res) delete[] sw->res;
+    sw->prev = sw->res = nullptr;
+    if (!ok) return false;
+
+    // Index: key count(4), then frame(4) | offset(8) per keyframe
+    const uint64_t idxOff = sw->pos;
+    put_u32(sw->out, static_cast<uint32_t>(sw->keys.size()));
+    for (const SeqKey& k : sw->keys)
+    {
+        put_u32(sw->out, k.frame);
+        put_u64(sw->out, k.off);
+    }
+    sw->out.seekp(18);
+    put_u32(sw->out, sw->cnt);
+    sw->out.seekp(26);
+    put_u64(sw->out, idxOff);
+    sw->out.close();
+    return !sw->out.fail();
+}
+
+
+void seq_abort(SeqWriter* sw)
+{
+    if (sw->prev) delete[] sw->prev;
+    if (sw->res) delete[] sw->res;
+    sw->prev = sw->res = nullptr;
+    sw->out.close();
+}
+
+
+bool seq_open(SeqReader* sr, const std::string& path)
+{
+    sr->prev = nullptr;
+    sr->tab = nullptr;
+    sr->root = nullptr;
+    sr->in.open(path, std::ios::binary);
+    if (!sr->in) return false;
+
+    uint8_t header[SEQ_HEAD_SZ];
+    if (!sr->in.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+    if (std::string_view(reinterpret_cast<char*>(header), SEQ_MAGIC.size()) != SEQ_MAGIC) return false;
+    if (header[6] != 0x01 || header[7] != 0x00) return false;
+    sr->w = get_u32(header + 8);
+    sr->h = get_u32(header + 12);
+    sr->c = header[16];
+    sr->cnt = get_u32(header + 18);
+    const uint64_t idxOff = get_u64(header + 26);
+    const size_t tot = static_cast<size_t>(sr->w) * static_cast<size_t>(sr->h) * static_cast<size_t>(sr->c);
+    if (!tot) return false;
+
+    sr->in.seekg(static_cast<std::streamoff>(idxOff));
+    uint8_t buf[12];
+    if (!sr->in.read(reinterpret_cast<char*>(buf), 4)) return false;
+    const uint32_t keyCnt = get_u32(buf);
+    if (keyCnt > sr->cnt) return false;
+    sr->keys.clear();
+    for (uint32_t i = 0; i < keyCnt; ++i)
+    {
+        if (!sr->in.read(reinterpret_cast<char*>(buf), 12)) return false;
+        const SeqKey k{get_u32(buf), get_u64(buf + 4)};
+        if (k.frame >= sr->cnt || (!sr->keys.empty() && k.frame <= sr->keys.back().frame)) return false;
+        sr->keys.push_back(k);
+    }
+    if (sr->cnt && (sr->keys.empty() || sr->keys[0].frame != 0)) return false;
+
+    sr->prev = new (std::nothrow) uint8_t[tot]();
+    sr->tab = new (std::nothrow) DecTable;
+    if (!sr->prev || !sr->tab) return false;
+    sr->in.seekg(SEQ_HEAD_SZ);
+    sr->next = 0;
+    return static_cast<bool>(sr->in);
+}
+
+
+void seq_close(SeqReader* sr)
+{
+    if (sr->prev) delete[] sr->prev;
+    if (sr->tab) delete sr->tab;
+    sr->prev = nullptr;
+    sr->tab = nullptr;
+    sr->in.close();
+}
+
+
+bool seq_read(SeqReader* sr, uint8_t* px)
+{
+    const size_t tot = static_cast<size_t>(sr->w) * static_cast<size_t>(sr->h) * static_cast<size_t>(sr->c);
+    if (!px || !sr->prev || sr->next >= sr->cnt) return false;
+
+    uint8_t head[2], sizeBuf[4];
+    if (!sr->in.read(reinterpret_cast<char*>(head), 2)) return false;
+    if (head[0] > SEQ_DELTA || head[1] > 1) return false;
+    if (head[0] == SEQ_KEY && !head[1]) return false; // Keyframes always carry their table
+    if (head[1])
+    {
+        if (!sr->in.read(reinterpret_cast<char*>(sizeBuf), 4)) return false;
+        const uint32_t trSz = get_u32(sizeBuf);
+        uint8_t tree[1024];
+        if (!trSz || trSz > sizeof(tree) || !sr->in.read(reinterpret_cast<char*>(tree), trSz)) return false;
+        BitStream trRder(tree, trSz);
+        size_t used = 0;
+        sr->root = load(&trRder, sr->pool, &used, COLOR_DEPTH * 2);
+        if (!sr->root || !dec_table(sr->root, sr->tab)) return false;
+    }
+    if (!sr->root) return false;
+
+    if (!sr->in.read(reinterpret_cast<char*>(sizeBuf), 4)) return false;
+    const uint32_t payloadSz = get_u32(sizeBuf);
+    if (payloadSz > tot * 8 + 16) return false; // Codes never exceed 64 bits, a longer payload is corrupt
+    sr->payload.resize(payloadSz);
+    if (payloadSz && !sr->in.read(reinterpret_cast<char*>(sr->payload.data()), payloadSz)) return false;
+    BitStream payloadRder(sr->payload.data(), payloadSz);
+    if (!extr_px(&payloadRder, px, tot, sr->c, sr->root, sr->tab)) return false;
+
+    if (head[0] == SEQ_DELTA)
+    {
+        for (size_t i = 0; i < tot; ++i) px[i] = static_cast<uint8_t>(px[i] + sr->prev[i]);
+    }
+    std::memcpy(sr->prev, px, tot);
+    sr->next++;
+    return true;
+}
+
+
+bool seq_seek(SeqReader* sr, uint32_t frame)
+{
+    if (frame >= sr->cnt || sr->keys.empty()) return false;
+
+    // Only restart at a keyframe when it is closer than carrying on from the current position
+    auto it = std::upper_bound(sr->keys.begin(), sr->keys.end(), frame,
+                               [](uint32_t f, const SeqKey& k) { return f < k.frame; });
+    const SeqKey& k = *(it - 1);
+    if (!(sr->next <= frame && sr->next > k.frame))
+    {
+        sr->in.clear();
+        sr->in.seekg(static_cast<std::streamoff>(k.off));
+        sr->next = k.frame;
+        sr->root = nullptr;
+    }
+
+    const size_t tot = static_cast<size_t>(sr->w) * static_cast<size_t>(sr->h) * static_cast<size_t>(sr->c);
+    uint8_t* scratch = sr->next < frame ? new (std::nothrow) uint8_t[tot] : nullptr;
+    if (sr->next < frame && !scratch) return false;
+    bool ok = true;
+    while (ok && sr->next < frame) ok = seq_read(sr, scratch);
+    if (scratch) delete[] scratch;
+    return ok;
+}
@@ -0,0 +1,299 @@
+#include "serve.hpp"
+#include "bit_io.hpp"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Wire format, both directions on one SOCK_STREAM connection that may carry many requests:
+//   request = op(1) | input path length(4) | output path length(4) | input path | output path
+//   reply   = status(1)
+
+static bool send_all(int fd, const void* buf, size_t sz)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    while (sz)
+    {
+        const ssize_t n = send(fd, p, sz, MSG_NOSIGNAL); // A vanished peer must not kill the daemon
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        sz -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool recv_all(int fd, void* buf, size_t sz)
+{
+    uint8_t* p = static_cast<uint8_t*>(buf);
+    while (sz)
+    {
+        const ssize_t n = recv(fd, p, sz, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        sz -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool sock_addr(sockaddr_un* addr, const std::string& sockPath)
+{
+    std::memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (sockPath.empty() || sockPath.size() >= sizeof(addr->sun_path)) return false;
+    std::memcpy(addr->sun_path, sockPath.data(), sockPath.size());
+    return true;
+}
+
+
+struct ServeReq
+{
+    int fd;
+    uint8_t op;
+    std::string in;
+    std::string out;
+};
+
+struct ServeQueue
+{
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<ServeReq> reqs;
+    std::vector<int> done; // Connections whose request was answered, handed back to the poller
+    bool stop = false;
+    int wake[2] = {-1, -1}; // Workers write a byte to break the poller out of poll()
+};
+
+// Pulls one complete request off the front of `buf`: 1 when one was taken, 0 when more bytes are needed,
+// -1 when the stream is malformed
+static int take_req(std::string* buf, ServeReq* req)
+{
+    if (buf->size() < 9) return 0;
+    const uint8_t* head = reinterpret_cast<const uint8_t*>(buf->data());
+    const uint32_t inLen = get_u32(head + 1), outLen = get_u32(head + 5);
+    if (inLen > SERVE_PATH_MAX || outLen > SERVE_PATH_MAX) return -1;
+    if (buf->size() < 9 + static_cast<size_t>(inLen) + outLen) return 0;
+    req->op = head[0];
+    req->in.assign(*buf, 9, inLen);
+    req->out.assign(*buf, 9 + inLen, outLen);
+    buf->erase(0, 9 + static_cast<size_t>(inLen) + outLen);
+    return 1;
+}
+
+
+static bool sock_free(const std::string& sockPath)
+{
+    // Only ever replace a stale socket, never a file that happens to sit at the path
+    struct stat st;
+    if (lstat(sockPath.c_str(), &st) != 0) return errno == ENOENT;
+    return S_ISSOCK(st.st_mode) && unlink(sockPath.c_str()) == 0;
+}
+
+
+bool serve_run(const std::string& sockPath, size_t workers, ServeFn fn)
+{
+    sockaddr_un addr;
+    if (!fn || !workers || !sock_addr(&addr, sockPath) || !sock_free(sockPath)) return false;
+    const int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) return false;
+    ServeQueue q;
+    if (bind(lfd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || listen(lfd, 128) != 0 ||
+        pipe2(q.wake, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        close(lfd);
+        return false;
+    }
+
+    // Workers live for the whole daemon and take one request at a time, an idle connection never holds one
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < workers; ++i)
+    {
+        pool.emplace_back([&]
+        {
+            for (;;)
+            {
+                ServeReq req;
+                {
+                    std::unique_lock<std::mutex> lock(q.mu);
+                    q.cv.wait(lock, [&] { return q.stop || !q.reqs.empty(); });
+                    if (q.reqs.empty()) return;
+                    req = std::move(q.reqs.front());
+                    q.reqs.pop_front();
+                }
+                const uint8_t status = static_cast<uint8_t>(fn(req.op, req.in, req.out));
+                send_all(req.fd, &status, 1); // A failed send shows up as a hang-up in the poller
+                {
+                    std::lock_guard<std::mutex> lock(q.mu);
+                    q.done.push_back(req.fd);
+                }
+                const uint8_t b = 0;
+                while (write(q.wake[1], &b, 1) < 0 && errno == EINTR) {}
+            }
+        });
+    }
+
+    // The accept thread polls every idle connection, assembles requests and queues them; ping, quit and
+    // malformed ops are answered here without a worker
+    std::map<int, std::string> conns; // fd -> bytes received but not yet parsed
+    std::set<int> busy;               // Connections with a request queued or running
+    bool quit = false;
+    std::vector<pollfd> pfds;
+    const auto drop = [&](int fd)
+    {
+        conns.erase(fd);
+        close(fd);
+    };
+    const auto pump = [&](int fd) // Queues or answers whatever complete request the connection holds
+    {
+        std::string& buf = conns[fd];
+        while (!quit && !busy.count(fd))
+        {
+            ServeReq req;
+            const int got = take_req(&buf, &req);
+            if (got < 0) drop(fd);
+            if (got <= 0) return;
+            req.fd = fd;
+            if (req.op == OP_ENCODE || req.op == OP_DECODE)
+            {
+                busy.insert(fd);
+                {
+                    std::lock_guard<std::mutex> lock(q.mu);
+                    q.reqs.push_back(std::move(req));
+                }
+                q.cv.notify_one();
+                return;
+            }
+            const uint8_t status = req.op == OP_PING || req.op == OP_QUIT ? 0 : 1;
+            quit = req.op == OP_QUIT;
+            if (!send_all(fd, &status, 1))
+            {
+                drop(fd);
+                return;
+            }
+        }
+    };
+
+    while (!quit)
+    {
+        pfds.clear();
+        pfds.push_back(pollfd{lfd, POLLIN, 0});
+        pfds.push_back(pollfd{q.wake[0], POLLIN, 0});
+        for (const auto& [fd, buf] : conns)
+        {
+            if (!busy.count(fd)) pfds.push_back(pollfd{fd, POLLIN, 0});
+        }
+        if (poll(pfds.data(), pfds.size(), -1) < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (pfds[1].revents)
+        {
+            uint8_t sink[64];
+            while (read(q.wake[0], sink, sizeof(sink)) == static_cast<ssize_t>(sizeof(sink))) {}
+            std::vector<int> back;
+            {
+                std::lock_guard<std::mutex> lock(q.mu);
+                back.swap(q.done);
+            }
+            for (int fd : back)
+            {
+                busy.erase(fd);
+                pump(fd); // A pipelined request may already be buffered
+            }
+        }
+        for (size_t i = 2; i < pfds.size() && !quit; ++i)
+        {
+            if (!pfds[i].revents) continue;
+            const int fd = pfds[i].fd;
+            char chunk[4096];
+            const ssize_t n = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+            if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+            if (n <= 0)
+            {
+                drop(fd);
+                continue;
+            }
+            conns[fd].append(chunk, static_cast<size_t>(n));
+            pump(fd);
+        }
+        if (!quit && pfds[0].revents)
+        {
+            const int fd = accept(lfd, nullptr, nullptr);
+            if (fd >= 0) conns[fd];
+        }
+    }
+
+    // Queued requests are dropped with their connections, running ones finish before everything closes
+    {
+        std::lock_guard<std::mutex> lock(q.mu);
+        q.stop = true;
+        q.reqs.clear();
+    }
+    q.cv.notify_all();
+    for (auto& th : pool) th.join();
+    for (const auto& [fd, buf] : conns) close(fd);
+    close(q.wake[0]);
+    close(q.wake[1]);
+    close(lfd);
+    unlink(sockPath.c_str());
+    return true;
+}
+
+
+bool serve_connect(ServeConn* sc, const std::string& sockPath)
+{
+    sc->fd = -1;
+    sockaddr_un addr;
+    if (!sock_addr(&addr, sockPath)) return false;
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    sc->fd = fd;
+    return true;
+}
+
+
+void serve_disconnect(ServeConn* sc)
+{
+    if (sc->fd >= 0) close(sc->fd);
+    sc->fd = -1;
+}
+
+
+int serve_call(ServeConn* sc, uint8_t op, const std::string& in, const std::string& out)
+{
+    if (sc->fd < 0 || in.size() > SERVE_PATH_MAX || out.size() > SERVE_PATH_MAX) return -1;
+    std::string req(9, '\0');
+    req[0] = static_cast<char>(op);
+    for (int i = 0; i < 4; ++i)
+    {
+        req[1 + i] = static_cast<char>((in.size() >> (8 * i)) & 0xFF);
+        req[5 + i] = static_cast<char>((out.size() >> (8 * i)) & 0xFF);
+    }
+    req += in;
+    req += out;
+
+    uint8_t status;
+    if (!send_all(sc->fd, req.data(), req.size()) || !recv_all(sc->fd, &status, 1)) return -1;
+    return status;
+}
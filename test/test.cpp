@@ -1,7 +1,23 @@
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+
 #include "huffman.hpp"
+#include "adaptive.hpp"
 #include "bit_io.hpp"
+#include "kernel.hpp"
+#include "pack.hpp"
+#include "sequence.hpp"
+#include "serve.hpp"
 
 
 bool compareTrees(const Node* a, const Node* b)
@@ -71,6 +87,342 @@ bool testCase(const char* name, Node* pool, size_t cnt, const Node* root)
 }
 
 
+bool testCkpt(size_t sz, size_t step, bool flat = false)
+{
+    std::cout << "\n=== Test: Checkpointed " << (flat ? "flat " : "") << "payload, " << sz << " symbols every " << step << " ===" << std::endl;
+
+    uint8_t* data = new uint8_t[sz];
+    for (size_t i = 0; i < sz; i++) data[i] = flat ? 42 : static_cast<uint8_t>((i * 7 + i / 13) % 61);
+
+    std::fill_n(g_freq, COLOR_DEPTH, 0ULL);
+    for (size_t i = 0; i < sz; i++) g_freq[data[i]]++;
+    std::fill_n(g_codes, COLOR_DEPTH, Code{0, 0});
+    Node* root = build_tree(nullptr);
+    get_codes(root, 0, 0);
+
+    const size_t markCnt = (sz - 1) / step;
+    const size_t bufSz = sz * 2 + 16;
+    uint8_t* buf = new uint8_t[bufSz];
+    uint32_t* marks = new uint32_t[markCnt + 1];
+    uint8_t* back = new uint8_t[sz];
+
+    BitStream bsW(buf, bufSz);
+    bool ok = comp_ckpt(&bsW, data, sz, step, marks, markCnt, 1);
+    const size_t bytes = bsW.flush();
+    if (!ok) std::cerr << "comp_ckpt failed" << std::endl;
+
+    ok = ok && extr_par(buf, bytes, back, sz, root, step, marks, markCnt, 1);
+    ok = ok && memcmp(data, back, sz) == 0;
+    std::cout << "Segments: " << markCnt + 1 << ", round trip: " << (ok ? "OK" : "FAILED") << std::endl;
+
+    if (ok && markCnt && !flat)
+    {
+        marks[0]++; // A corrupted index must be rejected, never silently misdecoded
+        ok = !extr_par(buf, bytes, back, sz, root, step, marks, markCnt, 1);
+        std::cout << "Corrupted index rejected: " << (ok ? "YES" : "NO") << std::endl;
+    }
+
+    delete[] back;
+    delete[] marks;
+    delete[] buf;
+    delete[] data;
+    return ok;
+}
+
+
+bool testPack()
+{
+    std::cout << "\n=== Test: Pack archive round trip ===" << std::endl;
+    const char* path = "test_pack.hfk";
+    const char* names[4] = {"b.png", "a.png", "c.png", "flat.png"};
+    uint8_t imgs[4][64 * 3];
+    for (size_t i = 0; i < 64 * 3; i++)
+    {
+        imgs[0][i] = static_cast<uint8_t>(i % 5);
+        imgs[1][i] = static_cast<uint8_t>(i % 7);
+        imgs[2][i] = static_cast<uint8_t>(200 + i % 3);
+        imgs[3][i] = 9;
+    }
+
+    uint64_t freq[COLOR_DEPTH] = {};
+    for (auto& img : imgs)
+        for (uint8_t v : img) freq[v]++;
+
+    PackWriter pw;
+    bool ok = pack_begin(&pw, path, freq);
+    for (size_t i = 0; ok && i < 4; i++) ok = pack_add(&pw, names[i], 8, 8, 3, imgs[i]);
+    ok = ok && pack_end(&pw);
+    if (!ok)
+    {
+        std::cerr << "Pack write failed" << std::endl;
+        return false;
+    }
+
+    PackReader pr;
+    if (!pack_open(&pr, path))
+    {
+        std::cerr << "Pack open failed" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; ok && i < 4; i++)
+    {
+        PackEntry e;
+        uint8_t back[64 * 3] = {};
+        ok = pack_find(&pr, names[i], &e) && pack_decode(&pr, e, back) && memcmp(back, imgs[i], sizeof(back)) == 0;
+        std::cout << names[i] << ": " << (ok ? "OK" : "FAILED") << std::endl;
+    }
+    PackEntry e;
+    ok = ok && !pack_find(&pr, "missing.png", &e);
+    ok = ok && pack_find(&pr, "flat.png", &e) && e.size <= 8; // Tree only, a flat entry needs no payload
+    std::cout << "Flat entry size: " << e.size << " bytes" << std::endl;
+    pack_close(&pr);
+    std::remove(path);
+    return ok;
+}
+
+
+bool testStream(size_t sz, size_t block)
+{
+    std::cout << "\n=== Test: Adaptive stream, " << sz << " bytes in blocks of " << block << " ===" << std::endl;
+
+    // Statistics drift halfway through, the rebuilt tables have to follow
+    std::string src(sz, '\0');
+    for (size_t i = 0; i < sz; i++) src[i] = static_cast<char>(i < sz / 2 ? i % 3 : 100 + (i * 31) % 17);
+
+    std::istringstream in(src);
+    std::stringstream enc;
+    if (!stream_encode(in, enc, block))
+    {
+        std::cerr << "stream_encode failed" << std::endl;
+        return false;
+    }
+    std::ostringstream dec;
+    if (!stream_decode(enc, dec))
+    {
+        std::cerr << "stream_decode failed" << std::endl;
+        return false;
+    }
+    bool ok = dec.str() == src;
+    std::cout << "Encoded: " << enc.str().size() << " bytes, round trip: " << (ok ? "OK" : "FAILED") << std::endl;
+
+    // A header claiming blocks past the encoder's limit must not size the decoder's buffers
+    std::string bad = enc.str().substr(0, 8) + std::string("\x00\x00\x00\x10", 4) + enc.str().substr(12);
+    std::istringstream badIn(bad);
+    std::ostringstream badOut;
+    ok = ok && !stream_decode(badIn, badOut);
+    return ok;
+}
+
+
+bool testKernels(size_t symCnt, uint8_t c)
+{
+    // Fibonacci counts give a maximally skewed tree, code lengths reach symCnt - 1
+    size_t sz = 0;
+    uint64_t fib[64] = {1, 1};
+    for (size_t i = 2; i < symCnt; i++) fib[i] = fib[i - 1] + fib[i - 2];
+    for (size_t i = 0; i < symCnt; i++) sz += fib[i];
+    sz -= sz % c;
+
+    uint8_t* data = new uint8_t[sz];
+    for (size_t i = 0, s = 0, left = fib[0]; i < sz; i++)
+    {
+        while (!left) left = fib[++s];
+        data[(i * 7919) % sz] = static_cast<uint8_t>(s * 3);
+        left--;
+    }
+
+    std::fill_n(g_freq, COLOR_DEPTH, 0ULL);
+    for (size_t i = 0; i < sz; i++) g_freq[data[i]]++;
+    std::fill_n(g_codes, COLOR_DEPTH, Code{0, 0});
+    Node* root = build_tree(nullptr);
+    get_codes(root, 0, 0);
+    size_t maxLen = 0;
+    for (const Code& code : g_codes) maxLen = std::max(maxLen, code.len);
+    std::cout << "\n=== Test: Kernels, " << static_cast<int>(c) << " channels, max code length " << maxLen << " ===" << std::endl;
+
+    // An odd bit offset up front checks that the kernels pick up and hand back a partial byte
+    const size_t bufSz = sz * 4 + 16;
+    uint8_t* ref = new uint8_t[bufSz]();
+    uint8_t* buf = new uint8_t[bufSz]();
+    uint8_t* back = new uint8_t[sz];
+    BitStream refW(ref, bufSz), bufW(buf, bufSz);
+    bool ok = refW.wbits(5, 3) && comp(&refW, data, sz) && refW.wbits(1, 1);
+    ok = ok && bufW.wbits(5, 3) && comp_px(&bufW, data, sz, c) && bufW.wbits(1, 1);
+    const size_t bytes = refW.flush();
+    ok = ok && bytes == bufW.flush() && memcmp(ref, buf, bytes) == 0;
+    std::cout << "Encoder matches comp(): " << (ok ? "YES" : "NO") << std::endl;
+
+    DecTable* tab = new DecTable;
+    BitStream bsR(buf, bytes);
+    uint64_t pre = 0, post = 0;
+    ok = ok && dec_table(root, tab) && bsR.rbits(&pre, 3) && extr_px(&bsR, back, sz, c, root, tab) && bsR.rbits(&post, 1);
+    ok = ok && pre == 5 && post == 1 && memcmp(data, back, sz) == 0;
+    std::cout << "Decoder (" << (tab->bits ? "lookup" : "tree walk") << ") round trip: " << (ok ? "OK" : "FAILED") << std::endl;
+
+    delete tab;
+    delete[] back;
+    delete[] buf;
+    delete[] ref;
+    delete[] data;
+    return ok;
+}
+
+
+bool testEstimate()
+{
+    std::cout << "\n=== Test: Size estimate and tight output ===" << std::endl;
+    const size_t sz = 300000;
+    uint8_t* noise = new uint8_t[sz];
+    uint8_t* coin = new uint8_t[sz];
+    uint32_t x = 12345;
+    for (size_t i = 0; i < sz; i++)
+    {
+        x = x * 1103515245u + 12345u;
+        noise[i] = static_cast<uint8_t>(x >> 24);
+        coin[i] = static_cast<uint8_t>(x >> 31) ? 200 : 7;
+    }
+
+    // Noise cannot shrink, two even symbols take one bit each
+    const uint64_t estNoise = est_bytes(noise, sz), estCoin = est_bytes(coin, sz);
+    bool ok = estNoise >= sz && estNoise < sz + sz / 50;
+    ok = ok && estCoin >= sz / 8 && estCoin < sz / 8 + 16;
+    std::cout << "Noise " << estNoise << ", coin " << estCoin << " of " << sz << " bytes: " << (ok ? "OK" : "FAILED") << std::endl;
+
+    // A buffer of exactly the coded size must be enough for the kernels, one byte less must fail
+    std::fill_n(g_freq, COLOR_DEPTH, 0ULL);
+    for (size_t i = 0; i < sz; i++) g_freq[coin[i]]++;
+    std::fill_n(g_codes, COLOR_DEPTH, Code{0, 0});
+    get_codes(build_tree(nullptr), 0, 0);
+    const size_t exact = (sz + 7) / 8;
+    uint8_t* buf = new uint8_t[exact];
+    BitStream fit(buf, exact), shortW(buf, exact - 1);
+    ok = ok && comp_px(&fit, coin, sz, 3) && fit.flush() == exact;
+    ok = ok && !comp_px(&shortW, coin, sz, 3);
+    std::cout << "Exact-size output buffer: " << (ok ? "OK" : "FAILED") << std::endl;
+
+    delete[] buf;
+    delete[] coin;
+    delete[] noise;
+    return ok;
+}
+
+
+bool testSequence()
+{
+    std::cout << "\n=== Test: Sequence round trip and seek ===" << std::endl;
+    const char* path = "test_seq.hfv";
+    constexpr size_t W = 16, H = 8, C = 3, N = 9;
+    uint8_t frames[N][W * H * C];
+    for (size_t f = 0; f < N; f++)
+    {
+        for (size_t i = 0; i < W * H * C; i++)
+        {
+            // Mostly static with a drifting patch, frames 5 and 6 identical
+            const size_t t = f == 6 ? 5 : f;
+            frames[f][i] = static_cast<uint8_t>(i % 11 + ((i / C) % W == t ? 40 : 0));
+        }
+    }
+
+    SeqWriter sw;
+    bool ok = seq_begin(&sw, path, W, H, C, 4);
+    uint64_t sizes[N] = {};
+    for (size_t f = 0; ok && f < N; f++)
+    {
+        const uint64_t at = sw.pos;
+        ok = seq_add(&sw, frames[f]);
+        sizes[f] = sw.pos - at;
+    }
+    ok = seq_end(&sw) && ok;
+    if (!ok)
+    {
+        std::cerr << "Sequence write failed" << std::endl;
+        return false;
+    }
+
+    // An unchanged frame is a single-symbol residual: header and tree, no payload
+    std::cout << "Unchanged frame: " << sizes[6] << " bytes" << std::endl;
+    ok = sizes[6] <= 16;
+
+    SeqReader sr;
+    uint8_t back[W * H * C];
+    ok = seq_open(&sr, path) && sr.cnt == N && sr.keys.size() == 3 && ok;
+    for (size_t f = 0; ok && f < N; f++) ok = seq_read(&sr, back) && memcmp(back, frames[f], sizeof(back)) == 0;
+    std::cout << "Sequential: " << (ok ? "OK" : "FAILED") << std::endl;
+    for (uint32_t f : {7u, 2u, 3u, 8u, 0u})
+    {
+        ok = ok && seq_seek(&sr, f) && seq_read(&sr, back) && memcmp(back, frames[f], sizeof(back)) == 0;
+    }
+    ok = ok && !seq_seek(&sr, N);
+    std::cout << "Seek: " << (ok ? "OK" : "FAILED") << std::endl;
+    seq_close(&sr);
+
+    // A frame claiming a payload longer than any coded frame must fail before it sizes a buffer
+    std::fstream patch(path, std::ios::in | std::ios::out | std::ios::binary);
+    uint8_t trLen[4];
+    patch.seekg(SEQ_HEAD_SZ + 2);
+    patch.read(reinterpret_cast<char*>(trLen), 4);
+    patch.seekp(static_cast<std::streamoff>(SEQ_HEAD_SZ + 6 + get_u32(trLen)));
+    const uint8_t huge[4] = {0x00, 0x00, 0x00, 0xF0};
+    patch.write(reinterpret_cast<const char*>(huge), 4);
+    patch.close();
+    ok = ok && seq_open(&sr, path) && !seq_read(&sr, back) && sr.payload.capacity() < 0xF0000000u;
+    seq_close(&sr);
+    std::cout << "Oversized payload rejected: " << (ok ? "YES" : "NO") << std::endl;
+    std::remove(path);
+    return ok;
+}
+
+
+int fakeReq(uint8_t op, const std::string& in, const std::string& out)
+{
+    return op == OP_ENCODE ? static_cast<int>(in.size()) : static_cast<int>(out.size() + 100);
+}
+
+
+bool testServe()
+{
+    std::cout << "\n=== Test: Serve request round trip ===" << std::endl;
+    const std::string sock = "test_serve.sock";
+    std::thread daemon([&] { serve_run(sock, 1, fakeReq); });
+
+    ServeConn sc, idle;
+    bool connected = false;
+    for (int i = 0; i < 200 && !connected; i++)
+    {
+        connected = serve_connect(&sc, sock);
+        if (!connected) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    // With a single worker an idle connection must not hold it, requests are queued one at a time
+    bool ok = connected && serve_connect(&idle, sock);
+    ok = ok && serve_call(&idle, OP_PING, "", "") == 0;
+    ok = ok && serve_call(&sc, OP_PING, "", "") == 0;
+    ok = ok && serve_call(&sc, OP_ENCODE, "abc", "xy") == 3;
+    ok = ok && serve_call(&sc, OP_DECODE, "abc", "xy") == 102;
+    ok = ok && serve_call(&sc, OP_QUIT, "", "") == 0;
+    uint8_t none;
+    pollfd hup{idle.fd, POLLIN, 0}; // Quit closes the connections left open
+    ok = ok && poll(&hup, 1, 2000) == 1 && recv(idle.fd, &none, 1, 0) == 0;
+    serve_disconnect(&idle);
+    serve_disconnect(&sc);
+    if (!connected) // Unblock the daemon so the join below returns
+    {
+        ServeConn q;
+        if (serve_connect(&q, sock)) serve_call(&q, OP_QUIT, "", "");
+    }
+    daemon.join();
+    std::cout << "Requests: " << (ok ? "OK" : "FAILED") << std::endl;
+
+    // Only a stale socket may be replaced, a regular file at the path is left alone
+    const char* notes = "test_serve.txt";
+    std::FILE* f = std::fopen(notes, "w");
+    const bool kept = f && std::fputs("keep", f) >= 0 && std::fclose(f) == 0 && !serve_run(notes, 1, fakeReq) &&
+                      std::filesystem::is_regular_file(notes);
+    std::remove(notes);
+    std::cout << "Regular file at the socket path kept: " << (kept ? "YES" : "NO") << std::endl;
+    return ok && kept;
+}
+
+
 int main()
 {
     int passed = 0;
@@ -216,6 +568,36 @@ int main()
         if (success) passed++;
     }
 
+    total++;
+    if (testCkpt(100000, 4096)) passed++;
+    total++;
+    if (testCkpt(8192, 4096)) passed++;
+    total++;
+    if (testCkpt(1000, 4096)) passed++;
+    total++;
+    if (testCkpt(480000, 65536 * 3, true)) passed++;
+
+    total++;
+    if (testPack()) passed++;
+    total++;
+    if (testStream(50000, 1024)) passed++;
+    total++;
+    if (testStream(0, 1024)) passed++;
+    total++;
+    if (testEstimate()) passed++;
+    total++;
+    if (testSequence()) passed++;
+    total++;
+    if (testServe()) passed++;
+    for (uint8_t c = 1; c <= 4; c++)
+    {
+        for (size_t symCnt : {3, 7, 12, 17, 23})
+        {
+            total++;
+            if (testKernels(symCnt, c)) passed++;
+        }
+    }
+
     std::cout << "\n=== Results ===" << std::endl;
     std::cout << "Passed: " << passed << "/" << total << std::endl;
 
@@ -22,6 +22,7 @@ target("HufPix")
     set_kind("binary")
     add_files("src/*.cpp")
     add_packages("stb")
+    add_syslinks("pthread")
     add_includedirs("include")
     set_rundir("$(projectdir)")
 
@@ -30,6 +31,15 @@ target("test")
     add_files("src/*.cpp", "test/*.cpp")
     remove_files("src/main.cpp")
     add_packages("stb")
+    add_syslinks("pthread")
+    add_includedirs("include")
+    set_rundir("$(projectdir)")
+
+target("bench")
+    set_kind("binary")
+    add_files("src/*.cpp", "bench/*.cpp")
+    remove_files("src/main.cpp")
+    add_syslinks("pthread")
     add_includedirs("include")
     set_rundir("$(projectdir)")
 